@@ -0,0 +1,102 @@
+#ifndef SCTPADDRESSSET_HPP
+#define SCTPADDRESSSET_HPP
+
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <type_traits>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "Lua/Lua.hpp"
+
+namespace Sctp {
+
+//Immutable list of addresses sharing a port, parsed once.
+//bind and connect take it in place of port, addr1, ... so repeated calls skip the parsing and the allocation.
+//The IP version is the one of the first address, the others have to match it
+class AddressSet {
+public:
+  static const char* MetaTableName;
+  template<int IPVersion>
+  using Addresses = std::vector<std::conditional_t<IPVersion == 4, sockaddr_in, sockaddr_in6>>;
+private:
+  Addresses<4> addresses4;
+  Addresses<6> addresses6;
+public:
+  template<int IPVersion>
+  auto addresses() const noexcept -> const Addresses<IPVersion>&;
+  auto load(Lua::State*, int portIdx) noexcept -> int;
+  auto pushKey(Lua::State*) const noexcept -> void;
+  auto len(Lua::State*) noexcept -> int;
+};
+
+template<>
+inline auto AddressSet::addresses<4>() const noexcept -> const Addresses<4>& {
+  return addresses4;
+}
+
+template<>
+inline auto AddressSet::addresses<6>() const noexcept -> const Addresses<6>& {
+  return addresses6;
+}
+
+//Parses port, addr1, ... from portIdx to the top of the stack. Returns 0, or the number of pushed error values
+inline auto AddressSet::load(Lua::State* L, int portIdx) noexcept -> int {
+  uint16_t port = htons(static_cast<uint16_t>(Lua::Aux::CheckInteger(L, portIdx)));
+  int count = Lua::GetTop(L) - portIdx;
+  if(count < 1) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "No addresses were given");
+    return 2;
+  }
+  bool isIPv6 = std::strchr(Lua::Aux::CheckString(L, portIdx + 1), ':') != nullptr;
+  if(isIPv6) {
+    addresses6.resize(count);
+    std::memset(addresses6.data(), 0, sizeof(sockaddr_in6) * count);
+  } else {
+    addresses4.resize(count);
+    std::memset(addresses4.data(), 0, sizeof(sockaddr_in) * count);
+  }
+  for(int i = 0; i < count; i++) {
+    auto ip = Lua::Aux::CheckString(L, portIdx + 1 + i);
+    int conversion;
+    if(isIPv6) {
+      addresses6[i].sin6_family = AF_INET6;
+      addresses6[i].sin6_port   = port;
+      conversion = ::inet_pton(AF_INET6, ip, &addresses6[i].sin6_addr);
+    } else {
+      addresses4[i].sin_family = AF_INET;
+      addresses4[i].sin_port   = port;
+      conversion = ::inet_pton(AF_INET, ip, &addresses4[i].sin_addr);
+    }
+    if(conversion <= 0) {
+      Lua::PushBoolean(L, false);
+      Lua::PushFString(L, (conversion == 0 ? "inet_pton: invalid IP: %s" : "inet_pton: %s"), conversion == 0 ? ip : std::strerror(errno));
+      return 2;
+    }
+  }
+  return 0;
+}
+
+//Pushes the packed addresses as a string, the same for every set of the same addresses in the same order.
+//They were zeroed before being filled in, so the padding doesn't make a difference
+inline auto AddressSet::pushKey(Lua::State* L) const noexcept -> void {
+  if(addresses4.empty()) {
+    Lua::PushLString(L, reinterpret_cast<const char*>(addresses6.data()), addresses6.size() * sizeof(sockaddr_in6));
+  } else {
+    Lua::PushLString(L, reinterpret_cast<const char*>(addresses4.data()), addresses4.size() * sizeof(sockaddr_in));
+  }
+}
+
+//__len: the number of addresses
+inline auto AddressSet::len(Lua::State* L) noexcept -> int {
+  Lua::PushInteger(L, static_cast<Lua::Integer>(addresses4.size() + addresses6.size()));
+  return 1;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPADDRESSSET_HPP */
@@ -0,0 +1,167 @@
+#ifndef SCTPBUFFER_HPP
+#define SCTPBUFFER_HPP
+
+#include <memory>
+#include <new>
+#include <cstring>
+#include <cstdint>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "Lua/Lua.hpp"
+
+namespace Sctp {
+
+//Fixed size, mutable byte buffer, so messages can be received into (and built in)
+//reused memory instead of a new Lua string each time.
+//Offsets are 0 based, multi-byte integers are big-endian unless "le" is given
+class Buffer {
+public:
+  static const char* MetaTableName;
+private:
+  std::unique_ptr<char[]> buffer;
+  std::size_t capacity;
+public:
+  Buffer(std::size_t size) noexcept;
+public:
+  auto data() noexcept -> char* { return buffer.get(); }
+  auto size() const noexcept -> std::size_t { return capacity; }
+  auto valid() const noexcept -> bool { return buffer != nullptr; }
+  auto checkRange(Lua::State*, int offsetIdx, std::size_t length) noexcept -> std::size_t;
+  auto receive(int fd, std::size_t offset, msghdr& msg) noexcept -> ssize_t;
+  static auto loadPayload(Lua::State*, int idx, iovec&) noexcept -> int;
+public:
+  auto len(Lua::State*) noexcept -> int;
+  template<class UInt>
+  auto get(Lua::State*) noexcept -> int;
+  template<class UInt>
+  auto set(Lua::State*) noexcept -> int;
+  auto getString(Lua::State*) noexcept -> int;
+  auto setString(Lua::State*) noexcept -> int;
+  auto fill(Lua::State*) noexcept -> int;
+private:
+  static auto isLittleEndian(Lua::State*, int idx) noexcept -> bool;
+};
+
+inline Buffer::Buffer(std::size_t size) noexcept : buffer(new (std::nothrow) char[size]), capacity(size) {
+  if(buffer == nullptr) {
+    capacity = 0;
+  }
+}
+
+//Raises an error unless [offset, offset + length) is inside the buffer, returns the offset
+inline auto Buffer::checkRange(Lua::State* L, int offsetIdx, std::size_t length) noexcept -> std::size_t {
+  auto offset = Lua::Aux::CheckInteger(L, offsetIdx);
+  if(offset < 0 or static_cast<std::size_t>(offset) > capacity or length > capacity - static_cast<std::size_t>(offset)) {
+    Lua::Aux::ArgError(L, offsetIdx, "out of bounds");
+  }
+  return static_cast<std::size_t>(offset);
+}
+
+//Receives (a piece of) a message to the given offset, the caller provides the control buffer
+inline auto Buffer::receive(int fd, std::size_t offset, msghdr& msg) noexcept -> ssize_t {
+  iovec iov;
+  iov.iov_base   = buffer.get() + offset;
+  iov.iov_len    = capacity - offset;
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
+  return ::recvmsg(fd, &msg, 0);
+}
+
+//The payload of a send: a string, or a buffer followed by an offset and a length, in which case the slice
+//is sent straight from the buffer. Returns the index of the argument after the payload
+inline auto Buffer::loadPayload(Lua::State* L, int idx, iovec& iov) noexcept -> int {
+  auto buf = Lua::Aux::TestUData<Buffer>(L, idx, MetaTableName);
+  if(buf == nullptr) {
+    std::size_t length;
+    iov.iov_base = const_cast<char*>(Lua::Aux::CheckLString(L, idx, length));
+    iov.iov_len  = length;
+    return idx + 1;
+  }
+  auto length = Lua::Aux::CheckInteger(L, idx + 2);
+  Lua::Aux::ArgCheck(L, length >= 0, idx + 2, "negative length");
+  iov.iov_base = buf->data() + buf->checkRange(L, idx + 1, static_cast<std::size_t>(length));
+  iov.iov_len  = static_cast<std::size_t>(length);
+  return idx + 3;
+}
+
+inline auto Buffer::isLittleEndian(Lua::State* L, int idx) noexcept -> bool {
+  auto endian = Lua::ToString(L, idx);
+  return endian != nullptr and endian[0] == 'l';
+}
+
+inline auto Buffer::len(Lua::State* L) noexcept -> int {
+  Lua::PushInteger(L, capacity);
+  return 1;
+}
+
+//get(offset [, "le"|"be"])
+template<class UInt>
+auto Buffer::get(Lua::State* L) noexcept -> int {
+  auto bytes = reinterpret_cast<const unsigned char*>(buffer.get() + checkRange(L, 2, sizeof(UInt)));
+  uint64_t value = 0;
+  if(isLittleEndian(L, 3)) {
+    for(std::size_t i = sizeof(UInt); i > 0; i--) {
+      value = (value << 8) | bytes[i - 1];
+    }
+  } else {
+    for(std::size_t i = 0; i < sizeof(UInt); i++) {
+      value = (value << 8) | bytes[i];
+    }
+  }
+  Lua::PushInteger(L, static_cast<Lua::Integer>(value));
+  return 1;
+}
+
+//set(offset, value [, "le"|"be"])
+template<class UInt>
+auto Buffer::set(Lua::State* L) noexcept -> int {
+  auto bytes = reinterpret_cast<unsigned char*>(buffer.get() + checkRange(L, 2, sizeof(UInt)));
+  auto value = static_cast<uint64_t>(Lua::Aux::CheckInteger(L, 3));
+  if(isLittleEndian(L, 4)) {
+    for(std::size_t i = 0; i < sizeof(UInt); i++, value >>= 8) {
+      bytes[i] = static_cast<unsigned char>(value);
+    }
+  } else {
+    for(std::size_t i = sizeof(UInt); i > 0; i--, value >>= 8) {
+      bytes[i - 1] = static_cast<unsigned char>(value);
+    }
+  }
+  return 0;
+}
+
+//string(offset, length): copies a slice out as a Lua string
+inline auto Buffer::getString(Lua::State* L) noexcept -> int {
+  auto length = Lua::Aux::CheckInteger(L, 3);
+  Lua::Aux::ArgCheck(L, length >= 0, 3, "negative length");
+  auto offset = checkRange(L, 2, static_cast<std::size_t>(length));
+  Lua::PushLString(L, buffer.get() + offset, static_cast<std::size_t>(length));
+  return 1;
+}
+
+//setstring(offset, str): copies str into the buffer, returns the offset right after it
+inline auto Buffer::setString(Lua::State* L) noexcept -> int {
+  std::size_t length;
+  auto str    = Lua::Aux::CheckLString(L, 3, length);
+  auto offset = checkRange(L, 2, length);
+  std::memcpy(buffer.get() + offset, str, length);
+  Lua::PushInteger(L, offset + length);
+  return 1;
+}
+
+//fill([byte [, offset [, length]]])
+inline auto Buffer::fill(Lua::State* L) noexcept -> int {
+  auto byte   = Lua::Aux::OptInteger(L, 2, 0);
+  auto offset = Lua::Aux::OptInteger(L, 3, 0);
+  Lua::Aux::ArgCheck(L, offset >= 0 and static_cast<std::size_t>(offset) <= capacity, 3, "out of bounds");
+  auto length = Lua::Aux::OptInteger(L, 4, capacity - offset);
+  Lua::Aux::ArgCheck(L, length >= 0 and static_cast<std::size_t>(length) <= capacity - offset, 4, "out of bounds");
+  std::memset(buffer.get() + offset, static_cast<int>(byte), static_cast<std::size_t>(length));
+  return 0;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPBUFFER_HPP */
@@ -1,7 +1,16 @@
 #ifndef SCTPCLIENTSOCKET_HPP
 #define SCTPCLIENTSOCKET_HPP
 
+#include <poll.h>
+
 #include "SctpSocket.hpp"
+#include "SctpRecvBuffer.hpp"
+#include "SctpRecvBatch.hpp"
+#include "SctpSendBatch.hpp"
+#include "SctpSendInfo.hpp"
+#include "SctpRecvInfo.hpp"
+#include "SctpNotification.hpp"
+#include "SctpBuffer.hpp"
 
 namespace Sctp {
 
@@ -11,76 +20,290 @@ template<int IPVersion>
 class Client final : public Base<IPVersion> {
 public:
   static const char* MetaTableName;
-  static const std::size_t MaxRecvBufferSize = 5000;
 private:
-  char recvBuffer[MaxRecvBufferSize];
+  RecvBuffer recvBuffer;
+  RecvBatch recvBatch;
+  SendBatch sendBatch;
+  bool connecting;
+  sctp_assoc_t assocId;
 public:
-  Client() : Base<IPVersion>() {}
-  Client(int sock);
+  Client(std::size_t recvBufferSize = RecvBuffer::DefaultSize) : Base<IPVersion>(), recvBuffer(recvBufferSize), connecting(false), assocId(0) {}
+  Client(int sock, bool isNonBlocking = false);
 public:
+  static auto push(Lua::State*, int sock, bool isNonBlocking) noexcept -> bool;
   auto connect(Lua::State*) noexcept -> int;
   auto sendmsg(Lua::State*) noexcept -> int;
+  auto sendmany(Lua::State*) noexcept -> int;
   auto recvmsg(Lua::State*) noexcept -> int;
+  auto recvmany(Lua::State*) noexcept -> int;
+  auto recvInto(Lua::State*) noexcept -> int;
+  auto setRecvBufferSize(Lua::State*) noexcept -> int;
 };
 
 template<int IPVersion>
-Client<IPVersion>::Client(int sock) : Base<IPVersion>(sock) {}
+Client<IPVersion>::Client(int sock, bool isNonBlocking) : Base<IPVersion>(sock), recvBuffer(), connecting(false), assocId(0) {
+  this->nonBlocking = isNonBlocking;
+}
+
+//Wraps an already connected descriptor (accepted, peeled off) into a new userdata, closes it on failure
+template<int IPVersion>
+auto Client<IPVersion>::push(Lua::State* L, int sock, bool isNonBlocking) noexcept -> bool {
+  auto connSock = Lua::NewUserData<Client<IPVersion>>(L);
+  if(connSock == nullptr) {
+    ::close(sock);
+    return false;
+  }
+
+  new (connSock) Client<IPVersion>(sock, isNonBlocking);
+
+  Lua::Aux::GetMetaTable(L, Client<IPVersion>::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  return true;
+}
 
+//connect(port, addr1, ...) or connect(addrset): returns true and the association id.
+//On a non-blocking socket it fails with "EINPROGRESS" and the association id first,
+//calling it again once the socket is writable reports the outcome (before that, it's "EINPROGRESS" again)
 template<int IPVersion>
 auto Client<IPVersion>::connect(Lua::State* L) noexcept -> int {
-  typename Base<IPVersion>::AddressArray peerAddresses;
-  int loadAddrResult = this->loadAddresses(L, peerAddresses);
-  if(loadAddrResult > 0) {
-    return loadAddrResult;
+  if(connecting) {
+    pollfd pfd;
+    pfd.fd     = this->fd;
+    pfd.events = POLLOUT;
+    if(::poll(&pfd, 1, 0) == 0) {
+      this->blocked = true;
+      Lua::PushBoolean(L, false);
+      Lua::PushString(L, "EINPROGRESS");
+      Lua::PushInteger(L, assocId);
+      return 3;
+    }
+    connecting = false;
+    int error = 0;
+    socklen_t errorLength = sizeof(int);
+    if(::getsockopt(this->fd, SOL_SOCKET, SO_ERROR, &error, &errorLength) < 0 or error != 0) {
+      //countFailure() classifies by errno, which still holds whatever the last call left there
+      if(error != 0) {
+        errno = error;
+      }
+      this->countFailure(Stats::Connect);
+      Lua::PushBoolean(L, false);
+      Lua::PushFString(L, "sctp_connectx: %s", std::strerror(errno));
+      return 2;
+    }
+    Lua::PushBoolean(L, true);
+    Lua::PushInteger(L, assocId);
+    return 2;
+  }
+
+  typename Base<IPVersion>::AddressArray parsedAddresses;
+  auto peerAddresses = this->addressSet(L, 2);
+  if(peerAddresses == nullptr) {
+    int loadAddrResult = this->loadAddresses(L, parsedAddresses);
+    if(loadAddrResult > 0) {
+      return loadAddrResult;
+    }
+    peerAddresses = &parsedAddresses;
   }
 
-  if(::sctp_connectx(this->fd, reinterpret_cast<sockaddr*>(peerAddresses.data()), peerAddresses.size(), nullptr) < 0) {
+  auto addrs = const_cast<sockaddr*>(reinterpret_cast<const sockaddr*>(peerAddresses->data()));
+  assocId = 0;
+  if(this->timed(Stats::Connect, [&] { return ::sctp_connectx(this->fd, addrs, peerAddresses->size(), &assocId); }) < 0) {
+    this->countFailure(Stats::Connect);
+    if(errno == EINPROGRESS) {
+      connecting    = true;
+      this->blocked = true;
+      Lua::PushBoolean(L, false);
+      Lua::PushString(L, "EINPROGRESS");
+      Lua::PushInteger(L, assocId);
+      return 3;
+    }
     Lua::PushBoolean(L, false);
     Lua::PushFString(L, "sctp_connectx: %s", std::strerror(errno));
     return 2;
   }
 
   Lua::PushBoolean(L, true);
-  return 1;
+  Lua::PushInteger(L, assocId);
+  return 2;
 }
 
+//send(payload [, opts]), see SendInfo::load() for the options. The payload is a string or buf, offset, length
 template<int IPVersion>
 auto Client<IPVersion>::sendmsg(Lua::State* L) noexcept -> int {
-  std::size_t bufferLength;
-  auto buffer = Lua::Aux::CheckLString(L, -1, bufferLength);
+  iovec iov;
+  int optsIdx = Buffer::loadPayload(L, 2, iov);
+
+  SendInfo info;
+  if(Lua::IsTable(L, optsIdx)) {
+    info.load(L, optsIdx);
+  }
+
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
 
-//  sctp_sndrcvinfo info;
-//  std::memset(&info, 0, sizeof(sctp_sndrcvinfo));
+  char control[SendInfo::ControlSize];
+  info.attach(msg, control);
 
-  //TODO: Add support for choosing at least ppid, stream number and flags
-  ssize_t numBytesSent = ::sctp_sendmsg(this->fd, buffer, bufferLength, nullptr, 0, 0, 0, 0, 0, 0);
+  ssize_t numBytesSent = this->timed(Stats::Send, [&] { return ::sendmsg(this->fd, &msg, 0); });
   if(numBytesSent < 0) {
+    this->countFailure(Stats::Send);
+    this->blocked = errno == EAGAIN;
     Lua::PushBoolean(L, false);
-    Lua::PushFString(L, (errno == EAGAIN ? "EAGAIN" : "sctp_sendmsg: %s"), std::strerror(errno));
+    Lua::PushFString(L, (errno == EAGAIN ? "EAGAIN" : "sendmsg: %s"), std::strerror(errno));
     return 2;
   }
+  this->countSent(1, numBytesSent);
   Lua::PushInteger(L, numBytesSent);
   return 1;
 }
 
+//sendmany(msgs): msgs is an array of payloads or {payload, stream, ppid, flags} entries.
+//Returns the number of messages sent, and the reason if that's less than #msgs
+template<int IPVersion>
+auto Client<IPVersion>::sendmany(Lua::State* L) noexcept -> int {
+  Lua::Aux::CheckType(L, 2, static_cast<int>(Lua::Types::Table));
+  return sendBatch.send(L, 2, 0, this->blocked, [this](mmsghdr* headers, unsigned count) { return this->sendMessages(headers, count); });
+}
+
+//recv([info]): returns the size and the message.
+//If a table is given, it's filled with the SCTP_RCVINFO fields
+//(stream, ssn, flags, ppid, tsn, cumtsn, context, assoc_id) and returned too.
+//Notifications are returned as tables in place of the message
 template<int IPVersion>
 auto Client<IPVersion>::recvmsg(Lua::State* L) noexcept -> int {
-//  sctp_sndrcvinfo info;
-//  std::memset(&info, 0, sizeof(sctp_sndrcvinfo));
+  char control[RecvInfo::ControlSize];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t numBytesReceived = this->timed(Stats::Recv, [&] { return recvBuffer.receive(this->fd, msg); });
+  if(numBytesReceived < 0) {
+    this->countFailure(Stats::Recv);
+    this->blocked = errno == EAGAIN or errno == EWOULDBLOCK;
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "recvmsg: %s"), std::strerror(errno));
+    return 2;
+  }
+  this->countReceived(1, numBytesReceived);
+  Lua::PushInteger(L, numBytesReceived);
+  Notification::pushMessage(L, recvBuffer.data(), numBytesReceived, msg);
+  this->forgetAddresses(L, recvBuffer.data(), numBytesReceived, msg);
+  recvBuffer.clear();
+  if(Lua::IsTable(L, 2)) {
+    RecvInfo::store(L, msg, 2);
+    Lua::PushValue(L, 2);
+    return 3;
+  }
+  return 2;
+}
 
-  //TODO: Add support for filling sctp_sndrcvinfo and flags
-  std::memset(&recvBuffer, 0, sizeof(recvBuffer));
-  ssize_t numBytesReceived = ::sctp_recvmsg(this->fd, recvBuffer, MaxRecvBufferSize, nullptr, nullptr, nullptr, nullptr);
+//recvmany([max [, msgs]]): receives up to max messages with one syscall,
+//returns their count and an array of them (msgs is filled if given)
+template<int IPVersion>
+auto Client<IPVersion>::recvmany(Lua::State* L) noexcept -> int {
+  auto maxCount = Lua::Aux::OptInteger(L, 2, RecvBatch::DefaultMessages);
+  Lua::Aux::ArgCheck(L, maxCount > 0 and maxCount <= static_cast<Lua::Integer>(RecvBatch::MaxMessages), 2, "batch size out of range");
+  if(Lua::IsTable(L, 3)) {
+    Lua::PushValue(L, 3);
+  } else {
+    Lua::CreateTable(L, maxCount, 0);
+  }
+  const int msgsIdx = Lua::GetTop(L);
+
+  Lua::Integer count = 0;
+  std::uint64_t bytes = 0;
+  auto handler = [this, L, msgsIdx, &count, &bytes](const char* data, std::size_t length, const msghdr& msg) {
+    bytes += length;
+    Notification::pushMessage(L, data, length, msg);
+    this->forgetAddresses(L, data, length, msg);
+    Lua::RawSet(L, msgsIdx, ++count);
+  };
+  int numMessages = this->timed(Stats::Recv, [&] { return recvBatch.receive(this->fd, recvBuffer, maxCount, handler); });
+  if(numMessages < 0) {
+    this->countFailure(Stats::Recv);
+    this->blocked = errno == EAGAIN or errno == EWOULDBLOCK;
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "recvmmsg: %s"), std::strerror(errno));
+    return 2;
+  }
+  this->countReceived(numMessages, bytes);
+  TrimArray(L, msgsIdx, count);
+  Lua::PushInteger(L, count);
+  Lua::Insert(L, msgsIdx);
+  return 2;
+}
+
+//recv_into(buf [, offset [, info]]): receives into a buffer userdata (to offset, default: 0) instead of a new string.
+//Returns the number of bytes and whether the message is complete. If it didn't fit,
+//the next call continues with the rest of it. Notifications are returned as tables in place of the flag,
+//the ones that didn't fit are completed in the receive buffer
+template<int IPVersion>
+auto Client<IPVersion>::recvInto(Lua::State* L) noexcept -> int {
+  auto buf    = Lua::Aux::CheckUData<Buffer>(L, 2, Buffer::MetaTableName);
+  auto offset = Lua::IsNoneOrNil(L, 3) ? 0 : buf->checkRange(L, 3, 1);
+  if(recvBuffer.pending() > 0 or recvBuffer.interleaved()) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "A partially received message is pending, use recv()");
+    return 2;
+  }
+
+  char control[RecvInfo::ControlSize];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t numBytesReceived = this->timed(Stats::Recv, [&] { return buf->receive(this->fd, offset, msg); });
+  const char* data = buf->data() + offset;
+  if(numBytesReceived >= 0 and (msg.msg_flags & MSG_NOTIFICATION) and not (msg.msg_flags & MSG_EOR)) {
+    //Notifications are decoded whole: the rest goes to recvBuffer, after the part that fit
+    //(if that fails, what arrived is pending for recv())
+    numBytesReceived = recvBuffer.finish(this->fd, data, numBytesReceived, msg);
+    data = recvBuffer.data();
+  }
   if(numBytesReceived < 0) {
+    this->countFailure(Stats::Recv);
+    this->blocked = errno == EAGAIN or errno == EWOULDBLOCK;
     Lua::PushBoolean(L, false);
-    Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "sctp_recvmsg: %s"), std::strerror(errno));
+    Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "recvmsg: %s"), std::strerror(errno));
     return 2;
   }
+
   Lua::PushInteger(L, numBytesReceived);
-  Lua::PushLString(L, recvBuffer, numBytesReceived);
+  const bool complete = msg.msg_flags & MSG_EOR;
+  this->countReceived(complete ? 1 : 0, numBytesReceived);
+  if(not complete) {
+    this->count(Stats::Truncated);
+  }
+  if(complete and (msg.msg_flags & MSG_NOTIFICATION)) {
+    Notification::push(L, data, numBytesReceived);
+    this->forgetAddresses(L, data, numBytesReceived, msg);
+    recvBuffer.clear();
+  } else {
+    Lua::PushBoolean(L, complete);
+  }
+  if(Lua::IsTable(L, 4)) {
+    RecvInfo::store(L, msg, 4);
+    Lua::PushValue(L, 4);
+    return 3;
+  }
   return 2;
 }
 
+template<int IPVersion>
+auto Client<IPVersion>::setRecvBufferSize(Lua::State* L) noexcept -> int {
+  auto size = Lua::Aux::CheckInteger(L, 2);
+  if(size <= 0 or not recvBuffer.resize(size)) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "Can't resize receive buffer to %d bytes", static_cast<int>(size));
+    return 2;
+  }
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
 } //namespace Socket
 
 } //namespace Sctp
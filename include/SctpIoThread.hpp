@@ -0,0 +1,610 @@
+#ifndef SCTPIOTHREAD_HPP
+#define SCTPIOTHREAD_HPP
+
+#include <memory>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <initializer_list>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpSocket.hpp"
+#include "SctpRing.hpp"
+#include "SctpRecvBuffer.hpp"
+#include "SctpRecvInfo.hpp"
+#include "SctpSendInfo.hpp"
+#include "SctpNotification.hpp"
+#include "SctpBuffer.hpp"
+
+namespace Sctp {
+
+//A native thread doing the send and receive syscalls of the attached sockets.
+//Outgoing messages reach it through one ring, received messages come back through another,
+//so the Lua side only copies messages in batches and never waits for the kernel.
+//The attached sockets are kept in the user value (fd -> socket), until detached or closed.
+//Every attachment gets a new generation, carried by its messages, so the messages of a closed socket
+//aren't given to the next one reusing its descriptor number
+class IoThread {
+public:
+  static const char* MetaTableName;
+  static constexpr std::size_t DefaultCapacity = 1024;
+  static constexpr int MaxEvents = 64;
+  static constexpr int DefaultPollCount = 64;
+private:
+  struct Message {
+    enum Kinds : uint8_t { Data, Notification, Error, Closed, Lost };
+    Kinds kind = Data;
+    int fd = -1;
+    uint32_t generation = 0;
+    int error = 0;
+    sctp_assoc_t assocId = 0;
+    std::size_t length = 0;
+    std::unique_ptr<char[]> data;
+  };
+  struct SendRequest {
+    int fd = -1;
+    uint32_t generation = 0;
+    //Not a message: the thread lets go of the socket (see forget())
+    bool detach = false;
+    SendInfo info;
+    std::size_t length = 0;
+    std::unique_ptr<char[]> data;
+  };
+private:
+  Ring<SendRequest> outbound;
+  Ring<Message> inbound;
+  int epollFD;
+  //Written by the Lua side to wake the thread, and by the thread when messages arrived
+  int wakeFD;
+  int readyFD;
+  std::atomic<bool> running;
+  std::atomic<bool> sleeping;
+  std::thread thread;
+  //Only touched by the thread
+  std::unordered_map<int, RecvBuffer> recvBuffers;
+  std::unordered_map<int, std::deque<SendRequest>> pendingSends;
+  //Errors and closed sockets that didn't fit the inbound ring, they go first once there's room
+  std::deque<Message> pendingReports;
+  //forget() waits until the thread has handled as many detach requests as it sent
+  std::mutex detachMutex;
+  std::condition_variable detached;
+  uint64_t detachRequests;
+  uint64_t detachesDone;
+  //Only touched by the Lua side: the generation of every attached fd
+  std::unordered_map<int, uint32_t> generations;
+  uint32_t lastGeneration;
+public:
+  IoThread(std::size_t capacity) noexcept;
+  ~IoThread();
+public:
+  auto create() noexcept -> bool;
+  auto attach(Lua::State*) noexcept -> int;
+  auto send(Lua::State*) noexcept -> int;
+  auto poll(Lua::State*) noexcept -> int;
+  auto wait(Lua::State*) noexcept -> int;
+  auto detach(Lua::State*) noexcept -> int;
+  auto close(Lua::State*) noexcept -> int;
+  auto forget(Lua::State*, int selfIdx, int sockIdx, int fd) noexcept -> void;
+private:
+  auto stop() noexcept -> void;
+  auto wake() noexcept -> void;
+  auto run() noexcept -> void;
+  auto receive(int fd, uint32_t generation) noexcept -> bool;
+  auto transmit(SendRequest&) noexcept -> int;
+  auto flush(int fd, uint32_t generation) noexcept -> bool;
+  auto report(int fd, uint32_t generation, Message::Kinds, int error) noexcept -> void;
+  auto deliverReports() noexcept -> bool;
+  auto drop(int fd) noexcept -> void;
+  auto watch(int fd, uint32_t generation, uint32_t events) noexcept -> bool;
+  auto pushSocket(Lua::State*, int uvIdx, const Message&) noexcept -> void;
+  static auto pushMessage(Lua::State*, Message&) noexcept -> void;
+  //The epoll data of an attachment
+  static auto key(int fd, uint32_t generation) noexcept -> uint64_t { return static_cast<uint64_t>(generation) << 32 | static_cast<uint32_t>(fd); }
+};
+
+inline IoThread::IoThread(std::size_t capacity) noexcept
+  : outbound(capacity), inbound(capacity), epollFD(-1), wakeFD(-1), readyFD(-1), running(false), sleeping(false), detachRequests(0), detachesDone(0), lastGeneration(0) {}
+
+inline IoThread::~IoThread() {
+  stop();
+}
+
+inline auto IoThread::create() noexcept -> bool {
+  if(not outbound.valid() or not inbound.valid()) {
+    errno = ENOMEM;
+    return false;
+  }
+  epollFD = ::epoll_create1(EPOLL_CLOEXEC);
+  wakeFD  = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  readyFD = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(epollFD < 0 or wakeFD < 0 or readyFD < 0) {
+    return false;
+  }
+  epoll_event ev;
+  std::memset(&ev, 0, sizeof(epoll_event));
+  ev.events   = EPOLLIN;
+  ev.data.u64 = key(wakeFD, 0);
+  if(::epoll_ctl(epollFD, EPOLL_CTL_ADD, wakeFD, &ev) < 0) {
+    return false;
+  }
+
+  running = true;
+  try {
+    thread = std::thread([this] { run(); });
+  } catch(...) {
+    running = false;
+    errno   = EAGAIN;
+    return false;
+  }
+  return true;
+}
+
+inline auto IoThread::stop() noexcept -> void {
+  if(running.exchange(false)) {
+    wake();
+    thread.join();
+  }
+  recvBuffers.clear();
+  pendingSends.clear();
+  pendingReports.clear();
+  for(int* fd : { &epollFD, &wakeFD, &readyFD }) {
+    if(*fd > -1) {
+      ::close(*fd);
+      *fd = -1;
+    }
+  }
+}
+
+inline auto IoThread::wake() noexcept -> void {
+  uint64_t one = 1;
+  ::write(wakeFD, &one, sizeof(uint64_t));
+}
+
+//False (errno set) if fd isn't watched anymore
+inline auto IoThread::watch(int fd, uint32_t generation, uint32_t events) noexcept -> bool {
+  epoll_event ev;
+  std::memset(&ev, 0, sizeof(epoll_event));
+  ev.events   = events;
+  ev.data.u64 = key(fd, generation);
+  return ::epoll_ctl(epollFD, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+//Errors and closed sockets are delivered like messages, they wait for room in the inbound ring instead of being lost
+inline auto IoThread::report(int fd, uint32_t generation, Message::Kinds kind, int error) noexcept -> void {
+  Message message;
+  message.kind       = kind;
+  message.fd         = fd;
+  message.generation = generation;
+  message.error      = error;
+  if(not pendingReports.empty() or not inbound.push(std::move(message))) {
+    pendingReports.push_back(std::move(message));
+  }
+}
+
+//Moves the reports that were kept back to the inbound ring while there's room, returns whether any was
+inline auto IoThread::deliverReports() noexcept -> bool {
+  bool delivered = false;
+  while(not pendingReports.empty() and inbound.push(std::move(pendingReports.front()))) {
+    pendingReports.pop_front();
+    delivered = true;
+  }
+  return delivered;
+}
+
+//Forgets everything about fd, so nothing of it is left for a socket reusing the number
+inline auto IoThread::drop(int fd) noexcept -> void {
+  ::epoll_ctl(epollFD, EPOLL_CTL_DEL, fd, nullptr);
+  recvBuffers.erase(fd);
+  pendingSends.erase(fd);
+}
+
+//Receives the complete messages of fd until EAGAIN or the inbound ring is full, returns whether any arrived
+inline auto IoThread::receive(int fd, uint32_t generation) noexcept -> bool {
+  auto& recvBuffer = recvBuffers[fd];
+  bool received    = false;
+  while(pendingReports.empty() and not inbound.full()) {
+    char control[RecvInfo::ControlSize];
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msghdr));
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t numBytesReceived = recvBuffer.receive(fd, msg);
+    if(numBytesReceived < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
+      break;
+    }
+    if(numBytesReceived <= 0) {
+      //The socket is dropped, so it doesn't keep waking the thread
+      report(fd, generation, numBytesReceived == 0 ? Message::Closed : Message::Error, errno);
+      drop(fd);
+      return true;
+    }
+
+    auto info = RecvInfo::find(msg);
+    Message message;
+    message.kind       = (msg.msg_flags & MSG_NOTIFICATION) ? Message::Notification : Message::Data;
+    message.fd         = fd;
+    message.generation = generation;
+    message.assocId    = info == nullptr ? 0 : info->rcv_assoc_id;
+    message.length     = static_cast<std::size_t>(numBytesReceived);
+    message.data.reset(new (std::nothrow) char[message.length]);
+    if(message.data == nullptr) {
+      //Delivered in place of the message, so the Lua side learns what it missed
+      message.kind  = Message::Lost;
+      message.error = ENOMEM;
+    } else {
+      std::memcpy(message.data.get(), recvBuffer.data(), message.length);
+    }
+    recvBuffer.clear();
+    inbound.push(std::move(message));
+    received = true;
+  }
+  return received;
+}
+
+//0 when sent, otherwise the errno
+inline auto IoThread::transmit(SendRequest& request) noexcept -> int {
+  iovec iov;
+  iov.iov_base = request.data.get();
+  iov.iov_len  = request.length;
+
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
+  char control[SendInfo::ControlSize];
+  request.info.attach(msg, control);
+  return ::sendmsg(request.fd, &msg, MSG_NOSIGNAL) < 0 ? errno : 0;
+}
+
+//Sends what's queued for fd while the socket takes it, returns whether an error was reported
+inline auto IoThread::flush(int fd, uint32_t generation) noexcept -> bool {
+  auto& queue = pendingSends[fd];
+  while(not queue.empty()) {
+    int error = transmit(queue.front());
+    if(error == EAGAIN) {
+      return false;
+    }
+    queue.pop_front();
+    if(error != 0) {
+      report(fd, generation, Message::Error, error);
+      return true;
+    }
+  }
+  pendingSends.erase(fd);
+  watch(fd, generation, EPOLLIN);
+  return false;
+}
+
+inline auto IoThread::run() noexcept -> void {
+  epoll_event events[MaxEvents];
+  while(running) {
+    bool arrived = deliverReports();
+
+    SendRequest request;
+    while(outbound.pop(request)) {
+      if(request.detach) {
+        drop(request.fd);
+        std::lock_guard<std::mutex> lock(detachMutex);
+        detachesDone++;
+        detached.notify_all();
+        continue;
+      }
+      //Messages queued earlier for the same socket go first
+      auto queued = pendingSends.find(request.fd);
+      int error   = queued == pendingSends.end() ? transmit(request) : EAGAIN;
+      if(error == EAGAIN and queued == pendingSends.end() and not watch(request.fd, request.generation, EPOLLIN | EPOLLOUT)) {
+        //Dropped already, it would wait for EPOLLOUT for good
+        error = errno;
+      }
+      if(error == EAGAIN) {
+        pendingSends[request.fd].push_back(std::move(request));
+      } else if(error != 0) {
+        report(request.fd, request.generation, Message::Error, error);
+        arrived = true;
+      }
+    }
+
+    //Announced before checking the ring again, so a request pushed in between always wakes us up.
+    //While the inbound ring is full nothing is read until the Lua side drains it
+    sleeping = true;
+    if(not outbound.empty() or not running or (not pendingReports.empty() and not inbound.full())) {
+      sleeping = false;
+      continue;
+    }
+    int numEvents;
+    if(inbound.full()) {
+      pollfd pfd = { wakeFD, POLLIN, 0 };
+      numEvents = ::poll(&pfd, 1, -1) > 0 ? 1 : 0;
+      events[0].data.u64 = key(wakeFD, 0);
+    } else {
+      numEvents = ::epoll_wait(epollFD, events, MaxEvents, -1);
+    }
+    sleeping = false;
+
+    for(int i = 0; i < numEvents; i++) {
+      int fd = static_cast<int>(events[i].data.u64 & 0xffffffff);
+      auto generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+      if(fd == wakeFD) {
+        uint64_t count;
+        ::read(wakeFD, &count, sizeof(uint64_t));
+        continue;
+      }
+      if(events[i].events & EPOLLOUT) {
+        arrived |= flush(fd, generation);
+      }
+      if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        arrived |= receive(fd, generation);
+      }
+    }
+
+    if(arrived) {
+      uint64_t one = 1;
+      ::write(readyFD, &one, sizeof(uint64_t));
+    }
+  }
+}
+
+//attach(sock): from now on the socket's messages are sent and received by the thread,
+//it's switched to non-blocking and shouldn't be used directly anymore
+inline auto IoThread::attach(Lua::State* L) noexcept -> int {
+  int fd = ToFileDescriptor(L, 2);
+  if(fd < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "Not an open socket");
+    return 2;
+  }
+  int flags = ::fcntl(fd, F_GETFL);
+  if(flags < 0 or ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "fcntl: %s", std::strerror(errno));
+    return 2;
+  }
+
+  uint32_t generation = lastGeneration + 1;
+  epoll_event ev;
+  std::memset(&ev, 0, sizeof(epoll_event));
+  ev.events   = EPOLLIN;
+  ev.data.u64 = key(fd, generation);
+  if(::epoll_ctl(epollFD, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "epoll_ctl(add): %s", std::strerror(errno));
+    return 2;
+  }
+  lastGeneration  = generation;
+  generations[fd] = generation;
+
+  Lua::GetUserValue(L, 1);
+  Lua::PushValue(L, 2);
+  Lua::RawSet(L, -2, static_cast<Lua::Integer>(fd));
+  Lua::Pop(L, 1);
+  Watch(L, 2, 1);
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//The socket at sockIdx is about to close fd (or is detached): waits until the thread has let go of it,
+//what's still queued for it is dropped. Messages of it that weren't polled yet come with no socket,
+//even once another socket is attached with the same fd (it has another generation)
+inline auto IoThread::forget(Lua::State* L, int selfIdx, int sockIdx, int fd) noexcept -> void {
+  Lua::GetUserValue(L, selfIdx);
+  Lua::RawGet(L, -1, static_cast<Lua::Integer>(fd));
+  bool attached = Lua::RawEqual(L, -1, sockIdx);
+  Lua::Pop(L, 1);
+  if(not attached) {
+    Lua::Pop(L, 1);
+    return;
+  }
+  Lua::PushNil(L);
+  Lua::RawSet(L, -2, static_cast<Lua::Integer>(fd));
+  Lua::Pop(L, 1);
+  generations.erase(fd);
+  if(not running) {
+    return;
+  }
+
+  SendRequest request;
+  request.fd     = fd;
+  request.detach = true;
+  //The thread drains the ring whenever it's woken, even while it can't deliver anything
+  while(not outbound.push(std::move(request))) {
+    wake();
+    std::this_thread::yield();
+  }
+  wake();
+  std::unique_lock<std::mutex> lock(detachMutex);
+  detachRequests++;
+  detached.wait(lock, [this] { return detachesDone >= detachRequests; });
+}
+
+//detach(sock): gives the socket back, it stays non-blocking
+inline auto IoThread::detach(Lua::State* L) noexcept -> int {
+  int fd = ToFileDescriptor(L, 2);
+  if(fd < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "Not an open socket");
+    return 2;
+  }
+  forget(L, 1, 2, fd);
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//send(sock, payload [, opts]): queues a copy of the message, payload as in Client::sendmsg.
+//opts are the same as for send, plus assoc_id for one-to-many sockets.
+//Returns false, "full" if the thread is behind, send errors are reported by poll()
+inline auto IoThread::send(Lua::State* L) noexcept -> int {
+  int fd = ToFileDescriptor(L, 2);
+  if(fd < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "Not an open socket");
+    return 2;
+  }
+  iovec iov;
+  int optsIdx = Buffer::loadPayload(L, 3, iov);
+  if(outbound.full()) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "full");
+    return 2;
+  }
+
+  SendRequest request;
+  request.fd = fd;
+  auto attached = generations.find(fd);
+  if(attached != generations.end()) {
+    request.generation = attached->second;
+  }
+  if(Lua::IsTable(L, optsIdx)) {
+    request.info.load(L, optsIdx);
+    if(Lua::GetField(L, optsIdx, "assoc_id") != Lua::Types::Nil) {
+      request.info.sndInfo.snd_assoc_id = static_cast<sctp_assoc_t>(Lua::ToInteger(L, -1));
+    }
+    Lua::Pop(L, 1);
+  }
+  request.length = iov.iov_len;
+  request.data.reset(new (std::nothrow) char[iov.iov_len]);
+  if(request.data == nullptr) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "Message allocation failed");
+    return 2;
+  }
+  std::memcpy(request.data.get(), iov.iov_base, iov.iov_len);
+  outbound.push(std::move(request));
+
+  if(sleeping.exchange(false)) {
+    wake();
+  }
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//Pushes the payload, or a table for notifications, errors ({ type = "error", error = "..." }), closed sockets
+//and messages that couldn't be kept ({ type = "lost", length = n, error = "..." })
+inline auto IoThread::pushMessage(Lua::State* L, Message& message) noexcept -> void {
+  switch(message.kind) {
+  case Message::Data:
+    Lua::PushLString(L, message.data.get(), message.length);
+    break;
+  case Message::Notification:
+    Notification::push(L, message.data.get(), message.length);
+    break;
+  case Message::Error:
+    Lua::CreateTable(L, 0, 2);
+    Lua::PushString(L, "error");
+    Lua::SetField(L, -2, "type");
+    Lua::PushString(L, std::strerror(message.error));
+    Lua::SetField(L, -2, "error");
+    break;
+  case Message::Closed:
+    Lua::CreateTable(L, 0, 1);
+    Lua::PushString(L, "closed");
+    Lua::SetField(L, -2, "type");
+    break;
+  case Message::Lost:
+    Lua::CreateTable(L, 0, 3);
+    Lua::PushString(L, "lost");
+    Lua::SetField(L, -2, "type");
+    Lua::PushInteger(L, static_cast<Lua::Integer>(message.length));
+    Lua::SetField(L, -2, "length");
+    Lua::PushString(L, std::strerror(message.error));
+    Lua::SetField(L, -2, "error");
+    break;
+  }
+}
+
+//Pushes the socket message came from, or nil if it's not attached anymore
+inline auto IoThread::pushSocket(Lua::State* L, int uvIdx, const Message& message) noexcept -> void {
+  auto attached = generations.find(message.fd);
+  if(attached == generations.end() or attached->second != message.generation) {
+    Lua::PushNil(L);
+    return;
+  }
+  Lua::RawGet(L, uvIdx, static_cast<Lua::Integer>(message.fd));
+}
+
+//poll([max [, msgs [, socks [, assocIds]]]]): takes up to max (default: 64) received messages without blocking.
+//Returns their count and parallel arrays of the messages, their sockets and association ids,
+//the given tables are reused
+inline auto IoThread::poll(Lua::State* L) noexcept -> int {
+  auto maxMessages = Lua::Aux::OptInteger(L, 2, DefaultPollCount);
+  Lua::Aux::ArgCheck(L, maxMessages > 0, 2, "must be positive");
+  Lua::SetTop(L, 5);
+  for(int idx = 3; idx <= 5; idx++) {
+    if(not Lua::IsTable(L, idx)) {
+      Lua::Newtable(L);
+      Lua::Replace(L, idx);
+    }
+  }
+  Lua::GetUserValue(L, 1);
+
+  const bool wasFull = inbound.full();
+  Lua::Integer count = 0;
+  Message message;
+  while(count < maxMessages and inbound.pop(message)) {
+    count++;
+    pushMessage(L, message);
+    Lua::RawSet(L, 3, count);
+    pushSocket(L, 6, message);
+    Lua::RawSet(L, 4, count);
+    Lua::PushInteger(L, message.assocId);
+    Lua::RawSet(L, 5, count);
+  }
+  for(int idx = 3; idx <= 5; idx++) {
+    TrimArray(L, idx, count);
+  }
+  if(wasFull and count > 0) {
+    wake();
+  }
+
+  Lua::PushInteger(L, count);
+  Lua::Replace(L, 2);
+  Lua::SetTop(L, 5);
+  return 4;
+}
+
+//wait([timeout]): blocks until messages may have arrived (true) or timeout milliseconds passed (false)
+inline auto IoThread::wait(Lua::State* L) noexcept -> int {
+  int timeout = static_cast<int>(Lua::Aux::OptInteger(L, 2, -1));
+  if(not inbound.empty()) {
+    Lua::PushBoolean(L, true);
+    return 1;
+  }
+  pollfd pfd = { readyFD, POLLIN, 0 };
+  int result = ::poll(&pfd, 1, timeout);
+  if(result < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EINTR ? "EINTR" : "poll: %s"), std::strerror(errno));
+    return 2;
+  }
+  if(result > 0) {
+    uint64_t count;
+    ::read(readyFD, &count, sizeof(uint64_t));
+  }
+  Lua::PushBoolean(L, result > 0 or not inbound.empty());
+  return 1;
+}
+
+//Stops the thread, the attached sockets stay open
+inline auto IoThread::close(Lua::State* L) noexcept -> int {
+  stop();
+  generations.clear();
+  Lua::Newtable(L);
+  Lua::SetUserValue(L, 1);
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPIOTHREAD_HPP */
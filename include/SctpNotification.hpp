@@ -0,0 +1,211 @@
+#ifndef SCTPNOTIFICATION_HPP
+#define SCTPNOTIFICATION_HPP
+
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netinet/sctp.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpSocket.hpp"
+#include "SctpRecvInfo.hpp"
+
+namespace Sctp {
+
+//Decodes the notifications (MSG_NOTIFICATION) into tables like
+//{ type = "assoc_change", state = "comm_up", assoc_id = 3, ... }
+class Notification {
+public:
+  static auto pushMessage(Lua::State*, const char* data, std::size_t length, const msghdr&) noexcept -> sctp_assoc_t;
+  static auto push(Lua::State*, const char* data, std::size_t length) noexcept -> sctp_assoc_t;
+private:
+  static auto size(uint16_t type) noexcept -> std::size_t;
+  static auto setInteger(Lua::State*, const char* key, Lua::Integer value) noexcept -> void;
+  static auto setString(Lua::State*, const char* key, const char* value) noexcept -> void;
+};
+
+inline auto Notification::setInteger(Lua::State* L, const char* key, Lua::Integer value) noexcept -> void {
+  Lua::PushInteger(L, value);
+  Lua::SetField(L, -2, key);
+}
+
+inline auto Notification::setString(Lua::State* L, const char* key, const char* value) noexcept -> void {
+  Lua::PushString(L, value);
+  Lua::SetField(L, -2, key);
+}
+
+//Pushes the payload, or the decoded notification if it's one, and returns the association id.
+//So a table in place of the message is the sign of a notification
+inline auto Notification::pushMessage(Lua::State* L, const char* data, std::size_t length, const msghdr& msg) noexcept -> sctp_assoc_t {
+  if(msg.msg_flags & MSG_NOTIFICATION) {
+    return push(L, data, length);
+  }
+  Lua::PushLString(L, data, length);
+  auto info = RecvInfo::find(msg);
+  return info == nullptr ? 0 : info->rcv_assoc_id;
+}
+
+//Size of the structure of a known notification type, 0 for the others
+inline auto Notification::size(uint16_t type) noexcept -> std::size_t {
+  switch(type) {
+  case SCTP_ASSOC_CHANGE:           return sizeof(sctp_assoc_change);
+  case SCTP_PEER_ADDR_CHANGE:       return sizeof(sctp_paddr_change);
+  case SCTP_REMOTE_ERROR:           return sizeof(sctp_remote_error);
+  case SCTP_SEND_FAILED:            return sizeof(sctp_send_failed);
+  case SCTP_SEND_FAILED_EVENT:      return sizeof(sctp_send_failed_event);
+  case SCTP_SHUTDOWN_EVENT:         return sizeof(sctp_shutdown_event);
+  case SCTP_PARTIAL_DELIVERY_EVENT: return sizeof(sctp_pdapi_event);
+  case SCTP_ADAPTATION_INDICATION:  return sizeof(sctp_adaptation_event);
+  case SCTP_AUTHENTICATION_EVENT:   return sizeof(sctp_authkey_event);
+  case SCTP_SENDER_DRY_EVENT:       return sizeof(sctp_sender_dry_event);
+  case SCTP_STREAM_RESET_EVENT:     return sizeof(sctp_stream_reset_event);
+  case SCTP_ASSOC_RESET_EVENT:      return sizeof(sctp_assoc_reset_event);
+  case SCTP_STREAM_CHANGE_EVENT:    return sizeof(sctp_stream_change_event);
+  default:                          return 0;
+  }
+}
+
+//Notifications of unknown types, or too short for their type, are { type = "unknown", sn_type = n, assoc_id = 0 }
+inline auto Notification::push(Lua::State* L, const char* data, std::size_t length) noexcept -> sctp_assoc_t {
+  static const char* const AssocStates[] = { "comm_up", "comm_lost", "restart", "shutdown_comp", "cant_str_assoc" };
+  static const char* const AddrStates[]  = { "available", "unreachable", "removed", "added", "made_prim", "confirmed", "potentially_failed" };
+
+  //recv_into() may leave it at any offset, so it's read from an aligned copy
+  sctp_notification notification;
+  std::memset(&notification, 0, sizeof(sctp_notification));
+  std::memcpy(&notification, data, length < sizeof(sctp_notification) ? length : sizeof(sctp_notification));
+  const auto sn = &notification;
+
+  Lua::CreateTable(L, 0, 6);
+  if(length < sizeof(sn->sn_header)) {
+    setString(L, "type", "unknown");
+    setInteger(L, "assoc_id", 0);
+    return 0;
+  }
+  const auto needed = size(sn->sn_header.sn_type);
+  if(needed == 0 or length < needed) {
+    setString(L, "type", "unknown");
+    setInteger(L, "sn_type", sn->sn_header.sn_type);
+    setInteger(L, "assoc_id", 0);
+    return 0;
+  }
+
+  sctp_assoc_t assocId = 0;
+  switch(sn->sn_header.sn_type) {
+  case SCTP_ASSOC_CHANGE: {
+    const auto& ev = sn->sn_assoc_change;
+    setString(L, "type", "assoc_change");
+    if(ev.sac_state < sizeof(AssocStates) / sizeof(AssocStates[0])) {
+      setString(L, "state", AssocStates[ev.sac_state]);
+    }
+    setInteger(L, "error", ev.sac_error);
+    setInteger(L, "outbound_streams", ev.sac_outbound_streams);
+    setInteger(L, "inbound_streams", ev.sac_inbound_streams);
+    assocId = ev.sac_assoc_id;
+    break;
+  }
+  case SCTP_PEER_ADDR_CHANGE: {
+    const auto& ev = sn->sn_paddr_change;
+    setString(L, "type", "peer_addr_change");
+    if(ev.spc_state >= 0 and static_cast<std::size_t>(ev.spc_state) < sizeof(AddrStates) / sizeof(AddrStates[0])) {
+      setString(L, "state", AddrStates[ev.spc_state]);
+    }
+    setInteger(L, "error", ev.spc_error);
+    sockaddr_storage addr;
+    std::memcpy(&addr, &ev.spc_aaddr, sizeof(sockaddr_storage));
+    if(PushAddress(L, reinterpret_cast<const sockaddr*>(&addr))) {
+      Lua::SetField(L, -2, "address");
+    }
+    assocId = ev.spc_assoc_id;
+    break;
+  }
+  case SCTP_REMOTE_ERROR: {
+    const auto& ev = sn->sn_remote_error;
+    setString(L, "type", "remote_error");
+    setInteger(L, "error", ntohs(ev.sre_error));
+    assocId = ev.sre_assoc_id;
+    break;
+  }
+  case SCTP_SEND_FAILED: {
+    const auto& ev = sn->sn_send_failed;
+    setString(L, "type", "send_failed");
+    setString(L, "state", ev.ssf_flags == SCTP_DATA_SENT ? "sent" : "unsent");
+    setInteger(L, "error", ev.ssf_error);
+    setInteger(L, "stream", ev.ssf_info.sinfo_stream);
+    setInteger(L, "ppid", ev.ssf_info.sinfo_ppid);
+    setInteger(L, "context", ev.ssf_info.sinfo_context);
+    if(length > sizeof(sctp_send_failed)) {
+      Lua::PushLString(L, data + sizeof(sctp_send_failed), length - sizeof(sctp_send_failed));
+      Lua::SetField(L, -2, "data");
+    }
+    assocId = ev.ssf_assoc_id;
+    break;
+  }
+  case SCTP_SEND_FAILED_EVENT: {
+    const auto& ev = sn->sn_send_failed_event;
+    setString(L, "type", "send_failed");
+    setString(L, "state", ev.ssf_flags == SCTP_DATA_SENT ? "sent" : "unsent");
+    setInteger(L, "error", ev.ssf_error);
+    setInteger(L, "stream", ev.ssfe_info.snd_sid);
+    setInteger(L, "ppid", ev.ssfe_info.snd_ppid);
+    setInteger(L, "context", ev.ssfe_info.snd_context);
+    if(length > sizeof(sctp_send_failed_event)) {
+      Lua::PushLString(L, data + sizeof(sctp_send_failed_event), length - sizeof(sctp_send_failed_event));
+      Lua::SetField(L, -2, "data");
+    }
+    assocId = ev.ssf_assoc_id;
+    break;
+  }
+  case SCTP_SHUTDOWN_EVENT:
+    setString(L, "type", "shutdown");
+    assocId = sn->sn_shutdown_event.sse_assoc_id;
+    break;
+  case SCTP_PARTIAL_DELIVERY_EVENT:
+    setString(L, "type", "partial_delivery");
+    setInteger(L, "indication", sn->sn_pdapi_event.pdapi_indication);
+    setInteger(L, "stream", sn->sn_pdapi_event.pdapi_stream);
+    setInteger(L, "seq", sn->sn_pdapi_event.pdapi_seq);
+    assocId = sn->sn_pdapi_event.pdapi_assoc_id;
+    break;
+  case SCTP_ADAPTATION_INDICATION:
+    setString(L, "type", "adaptation");
+    setInteger(L, "indication", sn->sn_adaptation_event.sai_adaptation_ind);
+    assocId = sn->sn_adaptation_event.sai_assoc_id;
+    break;
+  case SCTP_AUTHENTICATION_EVENT:
+    setString(L, "type", "authentication");
+    setInteger(L, "keynumber", sn->sn_authkey_event.auth_keynumber);
+    setInteger(L, "indication", sn->sn_authkey_event.auth_indication);
+    assocId = sn->sn_authkey_event.auth_assoc_id;
+    break;
+  case SCTP_SENDER_DRY_EVENT:
+    setString(L, "type", "sender_dry");
+    assocId = sn->sn_sender_dry_event.sender_dry_assoc_id;
+    break;
+  case SCTP_STREAM_RESET_EVENT:
+    setString(L, "type", "stream_reset");
+    setInteger(L, "flags", sn->sn_strreset_event.strreset_flags);
+    assocId = sn->sn_strreset_event.strreset_assoc_id;
+    break;
+  case SCTP_ASSOC_RESET_EVENT:
+    setString(L, "type", "assoc_reset");
+    setInteger(L, "flags", sn->sn_assocreset_event.assocreset_flags);
+    setInteger(L, "local_tsn", sn->sn_assocreset_event.assocreset_local_tsn);
+    setInteger(L, "remote_tsn", sn->sn_assocreset_event.assocreset_remote_tsn);
+    assocId = sn->sn_assocreset_event.assocreset_assoc_id;
+    break;
+  case SCTP_STREAM_CHANGE_EVENT:
+    setString(L, "type", "stream_change");
+    setInteger(L, "flags", sn->sn_strchange_event.strchange_flags);
+    setInteger(L, "inbound_streams", sn->sn_strchange_event.strchange_instrms);
+    setInteger(L, "outbound_streams", sn->sn_strchange_event.strchange_outstrms);
+    assocId = sn->sn_strchange_event.strchange_assoc_id;
+    break;
+  }
+  setInteger(L, "assoc_id", assocId);
+  return assocId;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPNOTIFICATION_HPP */
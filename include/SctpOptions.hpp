@@ -0,0 +1,337 @@
+#ifndef SCTPOPTIONS_HPP
+#define SCTPOPTIONS_HPP
+
+#include <cstring>
+#include <cerrno>
+#include <utility>
+
+#include <sys/socket.h>
+#include <netinet/sctp.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpSendInfo.hpp"
+
+namespace Sctp {
+
+//Typed setsockopt/getsockopt: options are known by name, structured ones are tables.
+//Fields left out of a table are 0, which the kernel takes as "keep the current value",
+//except for default_sndinfo, where 0 is a value: that one is read first and only the given fields are changed
+class Options {
+  enum class Kinds { Int, Bool, InitMsg, RtoInfo, AssocInfo, AssocValue, AssocBool, Scheduler, SndInfo };
+  struct Option {
+    const char* name;
+    int level;
+    int optName;
+    Kinds kind;
+  };
+  union Value {
+    int integer;
+    sctp_initmsg initMsg;
+    sctp_rtoinfo rtoInfo;
+    sctp_assocparams assocParams;
+    sctp_assoc_value assocValue;
+    sctp_sndinfo sndInfo;
+  };
+  //SCTP_SS_FC is missing from older kernel headers
+  static constexpr int FairCapacity = 3;
+public:
+  static auto set(Lua::State*, int fd) noexcept -> int;
+  static auto get(Lua::State*, int fd) noexcept -> int;
+  static auto setPriority(Lua::State*, int fd) noexcept -> int;
+  static auto getPriority(Lua::State*, int fd) noexcept -> int;
+  static auto abandoned(Lua::State*, int fd) noexcept -> int;
+private:
+  static auto find(Lua::State*, int nameIdx) noexcept -> const Option*;
+  static auto schedulers() noexcept -> const std::pair<const char*, int>*;
+  static auto prepare(const Option&, Value&, sctp_assoc_t assocId) noexcept -> socklen_t;
+  static auto load(Lua::State*, int valueIdx, const Option&, Value&) noexcept -> void;
+  static auto push(Lua::State*, const Option&, const Value&) noexcept -> void;
+  template<class T>
+  static auto loadField(Lua::State*, int tableIdx, const char* key, T& field) noexcept -> void;
+  static auto pushField(Lua::State*, const char* key, Lua::Integer value) noexcept -> void;
+};
+
+inline auto Options::find(Lua::State* L, int nameIdx) noexcept -> const Option* {
+  static const Option Known[] = {
+    { "sndbuf",              SOL_SOCKET,   SO_SNDBUF,                   Kinds::Int },
+    { "rcvbuf",              SOL_SOCKET,   SO_RCVBUF,                   Kinds::Int },
+    { "nodelay",             IPPROTO_SCTP, SCTP_NODELAY,                Kinds::Bool },
+    { "initmsg",             IPPROTO_SCTP, SCTP_INITMSG,                Kinds::InitMsg },
+    { "rtoinfo",             IPPROTO_SCTP, SCTP_RTOINFO,                Kinds::RtoInfo },
+    { "associnfo",           IPPROTO_SCTP, SCTP_ASSOCINFO,              Kinds::AssocInfo },
+    { "maxseg",              IPPROTO_SCTP, SCTP_MAXSEG,                 Kinds::AssocValue },
+    { "max_burst",           IPPROTO_SCTP, SCTP_MAX_BURST,              Kinds::AssocValue },
+    { "default_sndinfo",     IPPROTO_SCTP, SCTP_DEFAULT_SNDINFO,        Kinds::SndInfo },
+    { "fragment_interleave", IPPROTO_SCTP, SCTP_FRAGMENT_INTERLEAVE,    Kinds::Int },
+    { "interleaving",        IPPROTO_SCTP, SCTP_INTERLEAVING_SUPPORTED, Kinds::AssocBool },
+    { "stream_scheduler",    IPPROTO_SCTP, SCTP_STREAM_SCHEDULER,       Kinds::Scheduler },
+    { "pr_supported",        IPPROTO_SCTP, SCTP_PR_SUPPORTED,           Kinds::AssocBool },
+  };
+  auto name = Lua::Aux::CheckString(L, nameIdx);
+  for(const auto& option : Known) {
+    if(std::strcmp(option.name, name) == 0) {
+      return &option;
+    }
+  }
+  Lua::Aux::ArgError(L, nameIdx, "unknown option");
+  return nullptr;
+}
+
+//Names of the stream schedulers, terminated by a null name
+inline auto Options::schedulers() noexcept -> const std::pair<const char*, int>* {
+  static const std::pair<const char*, int> Schedulers[] = {
+    { "fcfs", SCTP_SS_FCFS },
+    { "prio", SCTP_SS_PRIO },
+    { "rr",   SCTP_SS_RR },
+    { "fc",   FairCapacity },
+    { nullptr, 0 },
+  };
+  return Schedulers;
+}
+
+//Zeroes the value, sets the association id of per association options and returns the option length
+inline auto Options::prepare(const Option& option, Value& value, sctp_assoc_t assocId) noexcept -> socklen_t {
+  std::memset(&value, 0, sizeof(Value));
+  switch(option.kind) {
+  case Kinds::Int:
+  case Kinds::Bool:
+    return sizeof(int);
+  case Kinds::InitMsg:
+    return sizeof(sctp_initmsg);
+  case Kinds::RtoInfo:
+    value.rtoInfo.srto_assoc_id = assocId;
+    return sizeof(sctp_rtoinfo);
+  case Kinds::AssocInfo:
+    value.assocParams.sasoc_assoc_id = assocId;
+    return sizeof(sctp_assocparams);
+  case Kinds::AssocValue:
+  case Kinds::AssocBool:
+  case Kinds::Scheduler:
+    value.assocValue.assoc_id = assocId;
+    return sizeof(sctp_assoc_value);
+  case Kinds::SndInfo:
+    value.sndInfo.snd_assoc_id = assocId;
+    return sizeof(sctp_sndinfo);
+  }
+  return 0;
+}
+
+template<class T>
+auto Options::loadField(Lua::State* L, int tableIdx, const char* key, T& field) noexcept -> void {
+  if(Lua::GetField(L, tableIdx, key) != Lua::Types::Nil) {
+    field = static_cast<T>(Lua::ToInteger(L, -1));
+  }
+  Lua::Pop(L, 1);
+}
+
+inline auto Options::pushField(Lua::State* L, const char* key, Lua::Integer value) noexcept -> void {
+  Lua::PushInteger(L, value);
+  Lua::SetField(L, -2, key);
+}
+
+inline auto Options::load(Lua::State* L, int valueIdx, const Option& option, Value& value) noexcept -> void {
+  switch(option.kind) {
+  case Kinds::Int:
+    value.integer = static_cast<int>(Lua::Aux::CheckInteger(L, valueIdx));
+    break;
+  case Kinds::Bool:
+    value.integer = Lua::ToBoolean(L, valueIdx) ? 1 : 0;
+    break;
+  case Kinds::AssocValue:
+    value.assocValue.assoc_value = static_cast<uint32_t>(Lua::Aux::CheckInteger(L, valueIdx));
+    break;
+  case Kinds::AssocBool:
+    value.assocValue.assoc_value = Lua::ToBoolean(L, valueIdx) ? 1 : 0;
+    break;
+  case Kinds::Scheduler: {
+    auto name = Lua::Aux::CheckString(L, valueIdx);
+    auto scheduler = schedulers();
+    while(scheduler->first != nullptr and std::strcmp(scheduler->first, name) != 0) {
+      scheduler++;
+    }
+    if(scheduler->first == nullptr) {
+      Lua::Aux::ArgError(L, valueIdx, "unknown stream scheduler");
+    }
+    value.assocValue.assoc_value = static_cast<uint32_t>(scheduler->second);
+    break;
+  }
+  case Kinds::InitMsg:
+    Lua::Aux::CheckType(L, valueIdx, static_cast<int>(Lua::Types::Table));
+    loadField(L, valueIdx, "ostreams", value.initMsg.sinit_num_ostreams);
+    loadField(L, valueIdx, "instreams", value.initMsg.sinit_max_instreams);
+    loadField(L, valueIdx, "max_attempts", value.initMsg.sinit_max_attempts);
+    loadField(L, valueIdx, "max_init_timeo", value.initMsg.sinit_max_init_timeo);
+    break;
+  case Kinds::RtoInfo:
+    Lua::Aux::CheckType(L, valueIdx, static_cast<int>(Lua::Types::Table));
+    loadField(L, valueIdx, "initial", value.rtoInfo.srto_initial);
+    loadField(L, valueIdx, "max", value.rtoInfo.srto_max);
+    loadField(L, valueIdx, "min", value.rtoInfo.srto_min);
+    break;
+  case Kinds::AssocInfo:
+    Lua::Aux::CheckType(L, valueIdx, static_cast<int>(Lua::Types::Table));
+    loadField(L, valueIdx, "max_retrans", value.assocParams.sasoc_asocmaxrxt);
+    loadField(L, valueIdx, "cookie_life", value.assocParams.sasoc_cookie_life);
+    break;
+  case Kinds::SndInfo: {
+    Lua::Aux::CheckType(L, valueIdx, static_cast<int>(Lua::Types::Table));
+    SendInfo info;
+    info.sndInfo = value.sndInfo;
+    info.load(L, valueIdx);
+    //SCTP_DEFAULT_SNDINFO has no room for the PR-SCTP policy
+    Lua::Aux::ArgCheck(L, not info.hasPrInfo, valueIdx, "ttl, rtx and prio can only be given per message");
+    value.sndInfo = info.sndInfo;
+    break;
+  }
+  }
+}
+
+inline auto Options::push(Lua::State* L, const Option& option, const Value& value) noexcept -> void {
+  switch(option.kind) {
+  case Kinds::Int:
+    Lua::PushInteger(L, value.integer);
+    break;
+  case Kinds::Bool:
+    Lua::PushBoolean(L, value.integer != 0);
+    break;
+  case Kinds::AssocValue:
+    Lua::PushInteger(L, value.assocValue.assoc_value);
+    break;
+  case Kinds::AssocBool:
+    Lua::PushBoolean(L, value.assocValue.assoc_value != 0);
+    break;
+  case Kinds::Scheduler: {
+    auto scheduler = schedulers();
+    while(scheduler->first != nullptr and scheduler->second != static_cast<int>(value.assocValue.assoc_value)) {
+      scheduler++;
+    }
+    if(scheduler->first != nullptr) {
+      Lua::PushString(L, scheduler->first);
+    } else {
+      Lua::PushInteger(L, value.assocValue.assoc_value);
+    }
+    break;
+  }
+  case Kinds::InitMsg:
+    Lua::CreateTable(L, 0, 4);
+    pushField(L, "ostreams", value.initMsg.sinit_num_ostreams);
+    pushField(L, "instreams", value.initMsg.sinit_max_instreams);
+    pushField(L, "max_attempts", value.initMsg.sinit_max_attempts);
+    pushField(L, "max_init_timeo", value.initMsg.sinit_max_init_timeo);
+    break;
+  case Kinds::RtoInfo:
+    Lua::CreateTable(L, 0, 3);
+    pushField(L, "initial", value.rtoInfo.srto_initial);
+    pushField(L, "max", value.rtoInfo.srto_max);
+    pushField(L, "min", value.rtoInfo.srto_min);
+    break;
+  case Kinds::AssocInfo:
+    Lua::CreateTable(L, 0, 5);
+    pushField(L, "max_retrans", value.assocParams.sasoc_asocmaxrxt);
+    pushField(L, "peer_destinations", value.assocParams.sasoc_number_peer_destinations);
+    pushField(L, "peer_rwnd", value.assocParams.sasoc_peer_rwnd);
+    pushField(L, "local_rwnd", value.assocParams.sasoc_local_rwnd);
+    pushField(L, "cookie_life", value.assocParams.sasoc_cookie_life);
+    break;
+  case Kinds::SndInfo:
+    Lua::CreateTable(L, 0, 4);
+    pushField(L, "stream", value.sndInfo.snd_sid);
+    pushField(L, "ppid", value.sndInfo.snd_ppid);
+    pushField(L, "context", value.sndInfo.snd_context);
+    Lua::PushBoolean(L, (value.sndInfo.snd_flags & SCTP_UNORDERED) != 0);
+    Lua::SetField(L, -2, "unordered");
+    break;
+  }
+}
+
+//setopt(name, value [, assocId])
+inline auto Options::set(Lua::State* L, int fd) noexcept -> int {
+  auto option = find(L, 2);
+  Value value;
+  auto length = prepare(*option, value, static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 4, 0)));
+  if(option->kind == Kinds::SndInfo and ::getsockopt(fd, option->level, option->optName, &value, &length) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "getsockopt(%s): %s", option->name, std::strerror(errno));
+    return 2;
+  }
+  load(L, 3, *option, value);
+  if(::setsockopt(fd, option->level, option->optName, &value, length) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "setsockopt(%s): %s", option->name, std::strerror(errno));
+    return 2;
+  }
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//getopt(name [, assocId])
+inline auto Options::get(Lua::State* L, int fd) noexcept -> int {
+  auto option = find(L, 2);
+  Value value;
+  auto length = prepare(*option, value, static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 3, 0)));
+  if(::getsockopt(fd, option->level, option->optName, &value, &length) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "getsockopt(%s): %s", option->name, std::strerror(errno));
+    return 2;
+  }
+  push(L, *option, value);
+  return 1;
+}
+
+//setpriority(stream, value [, assocId]): the stream's value for the current stream scheduler,
+//its priority with "prio" (lower goes first)
+inline auto Options::setPriority(Lua::State* L, int fd) noexcept -> int {
+  sctp_stream_value value;
+  value.stream_id    = static_cast<uint16_t>(Lua::Aux::CheckInteger(L, 2));
+  value.stream_value = static_cast<uint16_t>(Lua::Aux::CheckInteger(L, 3));
+  value.assoc_id     = static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 4, 0));
+  if(::setsockopt(fd, IPPROTO_SCTP, SCTP_STREAM_SCHEDULER_VALUE, &value, sizeof(sctp_stream_value)) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "setsockopt(SCTP_STREAM_SCHEDULER_VALUE): %s", std::strerror(errno));
+    return 2;
+  }
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//getpriority(stream [, assocId])
+inline auto Options::getPriority(Lua::State* L, int fd) noexcept -> int {
+  sctp_stream_value value;
+  value.stream_id    = static_cast<uint16_t>(Lua::Aux::CheckInteger(L, 2));
+  value.stream_value = 0;
+  value.assoc_id     = static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 3, 0));
+  socklen_t length = sizeof(sctp_stream_value);
+  if(::getsockopt(fd, IPPROTO_SCTP, SCTP_STREAM_SCHEDULER_VALUE, &value, &length) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "getsockopt(SCTP_STREAM_SCHEDULER_VALUE): %s", std::strerror(errno));
+    return 2;
+  }
+  Lua::PushInteger(L, value.stream_value);
+  return 1;
+}
+
+//abandoned([stream [, assocId]]): the number of messages PR-SCTP gave up on before and after sending them,
+//of the whole association or of a single stream
+inline auto Options::abandoned(Lua::State* L, int fd) noexcept -> int {
+  sctp_prstatus status;
+  std::memset(&status, 0, sizeof(sctp_prstatus));
+  status.sprstat_policy   = SCTP_PR_SCTP_ALL;
+  status.sprstat_assoc_id = static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 3, 0));
+  bool perStream = not Lua::IsNoneOrNil(L, 2);
+  if(perStream) {
+    status.sprstat_sid = static_cast<uint16_t>(Lua::Aux::CheckInteger(L, 2));
+  }
+  socklen_t length = sizeof(sctp_prstatus);
+  if(::getsockopt(fd, IPPROTO_SCTP, perStream ? SCTP_PR_STREAM_STATUS : SCTP_PR_ASSOC_STATUS, &status, &length) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "getsockopt(%s): %s", perStream ? "SCTP_PR_STREAM_STATUS" : "SCTP_PR_ASSOC_STATUS", std::strerror(errno));
+    return 2;
+  }
+  Lua::PushInteger(L, static_cast<Lua::Integer>(status.sprstat_abandoned_unsent));
+  Lua::PushInteger(L, static_cast<Lua::Integer>(status.sprstat_abandoned_sent));
+  return 2;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPOPTIONS_HPP */
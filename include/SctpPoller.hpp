@@ -0,0 +1,216 @@
+#ifndef SCTPPOLLER_HPP
+#define SCTPPOLLER_HPP
+
+#include <memory>
+#include <new>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpSocket.hpp"
+
+namespace Sctp {
+
+//epoll based readiness notification for any kind of socket of the module.
+//The registered sockets are kept in the poller's user value (fd -> socket),
+//so wait() can hand back the userdata itself. They stay there until they're removed or closed
+class Poller {
+public:
+  static const char* MetaTableName;
+  static constexpr int DefaultMaxEvents = 256;
+private:
+  int epollFD;
+  std::unique_ptr<epoll_event[]> events;
+  int eventCapacity;
+public:
+  Poller() noexcept : epollFD(-1), eventCapacity(0) {}
+  ~Poller();
+public:
+  auto create() noexcept -> bool;
+  auto add(Lua::State*) noexcept -> int;
+  auto modify(Lua::State*) noexcept -> int;
+  auto remove(Lua::State*) noexcept -> int;
+  auto wait(Lua::State*) noexcept -> int;
+  auto close(Lua::State*) noexcept -> int;
+  auto forget(Lua::State*, int selfIdx, int sockIdx, int fd) noexcept -> void;
+private:
+  auto control(Lua::State*, int op, const char* opName) noexcept -> int;
+  static auto parseEvents(const char*) noexcept -> uint32_t;
+  static auto pushEvents(Lua::State*, uint32_t) noexcept -> void;
+};
+
+inline Poller::~Poller() {
+  if(epollFD > -1) {
+    ::close(epollFD);
+  }
+}
+
+inline auto Poller::create() noexcept -> bool {
+  epollFD = ::epoll_create1(EPOLL_CLOEXEC);
+  return epollFD > -1;
+}
+
+//"r": readable, "w": writable, "e": edge-triggered,
+//"x": exclusive wakeup, when several pollers (threads) wait for the same socket only one of them is woken
+inline auto Poller::parseEvents(const char* str) noexcept -> uint32_t {
+  uint32_t result = 0;
+  for(; *str != '\0'; str++) {
+    switch(*str) {
+    case 'r': result |= EPOLLIN; break;
+    case 'w': result |= EPOLLOUT; break;
+    case 'e': result |= EPOLLET; break;
+    case 'x': result |= EPOLLEXCLUSIVE; break;
+    default: return 0;
+    }
+  }
+  return result;
+}
+
+//Same letters as above, "h" for hangup or error
+inline auto Poller::pushEvents(Lua::State* L, uint32_t evs) noexcept -> void {
+  char str[3];
+  std::size_t length = 0;
+  if(evs & EPOLLIN) {
+    str[length++] = 'r';
+  }
+  if(evs & EPOLLOUT) {
+    str[length++] = 'w';
+  }
+  if(evs & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+    str[length++] = 'h';
+  }
+  Lua::PushLString(L, str, length);
+}
+
+inline auto Poller::control(Lua::State* L, int op, const char* opName) noexcept -> int {
+  int fd = ToFileDescriptor(L, 2);
+  if(fd < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "Not an open socket");
+    return 2;
+  }
+
+  epoll_event ev;
+  std::memset(&ev, 0, sizeof(epoll_event));
+  ev.data.fd = fd;
+  if(op != EPOLL_CTL_DEL) {
+    ev.events = parseEvents(Lua::Aux::OptString(L, 3, "r"));
+    if((ev.events & (EPOLLIN | EPOLLOUT)) == 0) {
+      return Lua::Aux::ArgError(L, 3, "invalid event list");
+    }
+    //Not allowed together with EPOLLEXCLUSIVE
+    if((ev.events & EPOLLEXCLUSIVE) == 0) {
+      ev.events |= EPOLLRDHUP;
+    }
+  }
+
+  if(::epoll_ctl(epollFD, op, fd, &ev) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "epoll_ctl(%s): %s", opName, std::strerror(errno));
+    return 2;
+  }
+
+  Lua::GetUserValue(L, 1);
+  if(op == EPOLL_CTL_DEL) {
+    Lua::PushNil(L);
+  } else {
+    Lua::PushValue(L, 2);
+  }
+  Lua::RawSet(L, -2, static_cast<Lua::Integer>(fd));
+  Lua::Pop(L, 1);
+  if(op == EPOLL_CTL_ADD) {
+    Watch(L, 2, 1);
+  }
+
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//add(sock [, events]), events defaults to "r"
+inline auto Poller::add(Lua::State* L) noexcept -> int {
+  return control(L, EPOLL_CTL_ADD, "add");
+}
+
+inline auto Poller::modify(Lua::State* L) noexcept -> int {
+  return control(L, EPOLL_CTL_MOD, "mod");
+}
+
+inline auto Poller::remove(Lua::State* L) noexcept -> int {
+  return control(L, EPOLL_CTL_DEL, "del");
+}
+
+//wait([timeout [, max]]): timeout is in milliseconds, negative or nil means infinite.
+//Returns the number of ready sockets, an array of them and an array of their events
+inline auto Poller::wait(Lua::State* L) noexcept -> int {
+  int timeout   = static_cast<int>(Lua::Aux::OptInteger(L, 2, -1));
+  int maxEvents = static_cast<int>(Lua::Aux::OptInteger(L, 3, DefaultMaxEvents));
+  Lua::Aux::ArgCheck(L, maxEvents > 0, 3, "must be positive");
+
+  if(maxEvents > eventCapacity) {
+    std::unique_ptr<epoll_event[]> newEvents(new (std::nothrow) epoll_event[maxEvents]);
+    if(newEvents == nullptr) {
+      Lua::PushBoolean(L, false);
+      Lua::PushString(L, "Event array allocation failed");
+      return 2;
+    }
+    events        = std::move(newEvents);
+    eventCapacity = maxEvents;
+  }
+
+  int numEvents = ::epoll_wait(epollFD, events.get(), maxEvents, timeout);
+  if(numEvents < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EINTR ? "EINTR" : "epoll_wait: %s"), std::strerror(errno));
+    return 2;
+  }
+
+  Lua::PushInteger(L, numEvents);
+  Lua::GetUserValue(L, 1);
+  Lua::CreateTable(L, numEvents, 0);
+  Lua::CreateTable(L, numEvents, 0);
+  for(int i = 0; i < numEvents; i++) {
+    Lua::RawGet(L, -3, static_cast<Lua::Integer>(events[i].data.fd));
+    Lua::RawSet(L, -3, i + 1);
+    pushEvents(L, events[i].events);
+    Lua::RawSet(L, -2, i + 1);
+  }
+  Lua::Remove(L, -3);
+  return 3;
+}
+
+//The socket at sockIdx is about to close fd: it's dropped, so the entry can't be taken for a socket reusing the fd
+inline auto Poller::forget(Lua::State* L, int selfIdx, int sockIdx, int fd) noexcept -> void {
+  Lua::GetUserValue(L, selfIdx);
+  Lua::RawGet(L, -1, static_cast<Lua::Integer>(fd));
+  bool registered = Lua::RawEqual(L, -1, sockIdx);
+  Lua::Pop(L, 1);
+  if(registered) {
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(epoll_event));
+    ::epoll_ctl(epollFD, EPOLL_CTL_DEL, fd, &ev);
+    Lua::PushNil(L);
+    Lua::RawSet(L, -2, static_cast<Lua::Integer>(fd));
+  }
+  Lua::Pop(L, 1);
+}
+
+inline auto Poller::close(Lua::State* L) noexcept -> int {
+  if(epollFD > -1 and ::close(epollFD) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "close: %s", std::strerror(errno));
+    epollFD = -1;
+    return 2;
+  }
+  epollFD = -1;
+  Lua::Newtable(L);
+  Lua::SetUserValue(L, 1);
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPPOLLER_HPP */
@@ -0,0 +1,411 @@
+#ifndef SCTPPOOL_HPP
+#define SCTPPOOL_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#include <poll.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpSocket.hpp"
+#include "SctpAddressSet.hpp"
+
+namespace Sctp {
+
+//Established client associations kept for reuse, keyed by the peer's addresses (AddressSet::pushKey()),
+//so separately parsed sets of the same peer share its sockets.
+//At most maxPerPeer sockets (handed out or idle) exist per peer. An idle socket is dropped when it
+//has been idle for too long, or when it became readable: an idle association has nothing to say,
+//unless it was shut down, aborted or has a notification (e.g. assoc_change) pending.
+//The user value holds the entries by peer, the entry of each socket, the idle sockets and the socket constructors.
+//A peer's entry is removed once it has no sockets left. The pool watches its sockets (see Watch()),
+//so closing one instead of releasing it frees its place too
+class Pool {
+public:
+  static const char* MetaTableName;
+  static constexpr int DefaultMaxPerPeer   = 8;
+  static constexpr int DefaultIdleTimeout  = 60000;
+private:
+  enum Slots : Lua::Integer { Peers = 1, Owners = 2, NewSocket4 = 3, NewSocket6 = 4, IdleSockets = 5 };
+  //Idle sockets (the most recently used last) and when they were released, the number of sockets of the peer, its key
+  enum EntrySlots : Lua::Integer { Idle = 1, Since = 2, Count = 3, Key = 4 };
+private:
+  int maxPerPeer;
+  int64_t idleTimeout;
+  Lua::Integer recvBufferSize;
+public:
+  Pool(int maxPerPeer, int64_t idleTimeout, Lua::Integer recvBufferSize) noexcept
+    : maxPerPeer(maxPerPeer), idleTimeout(idleTimeout), recvBufferSize(recvBufferSize) {}
+public:
+  static auto create(Lua::State*, Lua::CFunction newSocket4, Lua::CFunction newSocket6) noexcept -> void;
+  auto acquire(Lua::State*) noexcept -> int;
+  auto release(Lua::State*) noexcept -> int;
+  auto expire(Lua::State*) noexcept -> int;
+  auto size(Lua::State*) noexcept -> int;
+  auto close(Lua::State*) noexcept -> int;
+  static auto forget(Lua::State*, int selfIdx, int sockIdx) noexcept -> void;
+private:
+  static auto now() noexcept -> int64_t;
+  static auto isHealthy(int fd) noexcept -> bool;
+  static auto closeSocket(Lua::State*, int sockIdx) noexcept -> void;
+  static auto pushEntry(Lua::State*, int uvIdx, const AddressSet&, bool create) noexcept -> void;
+  static auto forgetIfEmpty(Lua::State*, int uvIdx, int entryIdx) noexcept -> void;
+  static auto isIdle(Lua::State*, int uvIdx, int sockIdx) noexcept -> bool;
+  static auto setIdle(Lua::State*, int uvIdx, int sockIdx, bool idle) noexcept -> void;
+  static auto removeIdle(Lua::State*, int entryIdx, int sockIdx) noexcept -> void;
+  static auto disown(Lua::State*, int uvIdx, int entryIdx, int sockIdx) noexcept -> void;
+  static auto drop(Lua::State*, int uvIdx, int entryIdx, int sockIdx) noexcept -> void;
+  auto expireIdle(Lua::State*, int64_t maxIdle) noexcept -> Lua::Integer;
+};
+
+inline auto Pool::now() noexcept -> int64_t {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline auto Pool::isHealthy(int fd) noexcept -> bool {
+  if(fd < 0) {
+    return false;
+  }
+  pollfd pfd = { fd, POLLIN, 0 };
+  return ::poll(&pfd, 1, 0) == 0;
+}
+
+inline auto Pool::closeSocket(Lua::State* L, int sockIdx) noexcept -> void {
+  Lua::GetField(L, sockIdx, "close");
+  Lua::PushValue(L, sockIdx);
+  Lua::Call(L, 1, 0);
+}
+
+//Expects the pool on the top of the stack, sets up its user value
+inline auto Pool::create(Lua::State* L, Lua::CFunction newSocket4, Lua::CFunction newSocket6) noexcept -> void {
+  Lua::CreateTable(L, 5, 0);
+  Lua::Newtable(L);
+  Lua::RawSet(L, -2, Peers);
+  Lua::Newtable(L);
+  Lua::RawSet(L, -2, Owners);
+  Lua::Newtable(L);
+  Lua::RawSet(L, -2, IdleSockets);
+  Lua::PushCFunction(L, newSocket4);
+  Lua::RawSet(L, -2, NewSocket4);
+  Lua::PushCFunction(L, newSocket6);
+  Lua::RawSet(L, -2, NewSocket6);
+  Lua::SetUserValue(L, -2);
+}
+
+//Pushes the entry of the peer, creating it on first use if create is true (nil otherwise)
+inline auto Pool::pushEntry(Lua::State* L, int uvIdx, const AddressSet& set, bool create) noexcept -> void {
+  Lua::RawGet(L, uvIdx, Peers);
+  set.pushKey(L);
+  Lua::PushValue(L, -1);
+  if(Lua::RawGet(L, -3) == Lua::Types::Nil and create) {
+    Lua::Pop(L, 1);
+    Lua::CreateTable(L, 4, 0);
+    Lua::Newtable(L);
+    Lua::RawSet(L, -2, Idle);
+    Lua::Newtable(L);
+    Lua::RawSet(L, -2, Since);
+    Lua::PushInteger(L, 0);
+    Lua::RawSet(L, -2, Count);
+    Lua::PushValue(L, -2);
+    Lua::RawSet(L, -2, Key);
+    Lua::PushValue(L, -2);
+    Lua::PushValue(L, -2);
+    Lua::RawSet(L, -5);
+  }
+  Lua::Replace(L, -3);
+  Lua::Pop(L, 1);
+}
+
+//Removes the entry of a peer without sockets, so the pool doesn't keep every peer it ever connected to
+inline auto Pool::forgetIfEmpty(Lua::State* L, int uvIdx, int entryIdx) noexcept -> void {
+  Lua::RawGet(L, entryIdx, Count);
+  bool empty = Lua::ToInteger(L, -1) == 0;
+  Lua::Pop(L, 1);
+  if(empty) {
+    Lua::RawGet(L, uvIdx, Peers);
+    Lua::RawGet(L, entryIdx, Key);
+    Lua::PushNil(L);
+    Lua::RawSet(L, -3);
+    Lua::Pop(L, 1);
+  }
+}
+
+inline auto Pool::isIdle(Lua::State* L, int uvIdx, int sockIdx) noexcept -> bool {
+  Lua::RawGet(L, uvIdx, IdleSockets);
+  Lua::PushValue(L, sockIdx);
+  bool idle = Lua::RawGet(L, -2) != Lua::Types::Nil;
+  Lua::Pop(L, 2);
+  return idle;
+}
+
+inline auto Pool::setIdle(Lua::State* L, int uvIdx, int sockIdx, bool idle) noexcept -> void {
+  Lua::RawGet(L, uvIdx, IdleSockets);
+  Lua::PushValue(L, sockIdx);
+  if(idle) {
+    Lua::PushBoolean(L, true);
+  } else {
+    Lua::PushNil(L);
+  }
+  Lua::RawSet(L, -3);
+  Lua::Pop(L, 1);
+}
+
+//Takes an idle socket out of its entry's arrays, the ones after it move down
+inline auto Pool::removeIdle(Lua::State* L, int entryIdx, int sockIdx) noexcept -> void {
+  Lua::RawGet(L, entryIdx, Idle);
+  Lua::RawGet(L, entryIdx, Since);
+  const int idleIdx  = Lua::GetTop(L) - 1;
+  const int sinceIdx = idleIdx + 1;
+  auto n = static_cast<Lua::Integer>(Lua::RawLen(L, idleIdx));
+  Lua::Integer i = 1;
+  for(; i <= n; i++) {
+    Lua::RawGet(L, idleIdx, i);
+    bool found = Lua::RawEqual(L, -1, sockIdx);
+    Lua::Pop(L, 1);
+    if(found) {
+      break;
+    }
+  }
+  for(; i < n; i++) {
+    Lua::RawGet(L, idleIdx, i + 1);
+    Lua::RawSet(L, idleIdx, i);
+    Lua::RawGet(L, sinceIdx, i + 1);
+    Lua::RawSet(L, sinceIdx, i);
+  }
+  if(i == n) {
+    Lua::PushNil(L);
+    Lua::RawSet(L, idleIdx, n);
+    Lua::PushNil(L);
+    Lua::RawSet(L, sinceIdx, n);
+  }
+  Lua::Pop(L, 2);
+}
+
+//Forgets a socket of the pool (not in the idle arrays anymore), its place is free again
+inline auto Pool::disown(Lua::State* L, int uvIdx, int entryIdx, int sockIdx) noexcept -> void {
+  Lua::RawGet(L, entryIdx, Count);
+  Lua::PushInteger(L, Lua::ToInteger(L, -1) - 1);
+  Lua::RawSet(L, entryIdx, Count);
+  Lua::Pop(L, 1);
+  Lua::RawGet(L, uvIdx, Owners);
+  Lua::PushValue(L, sockIdx);
+  Lua::PushNil(L);
+  Lua::RawSet(L, -3);
+  Lua::Pop(L, 1);
+  setIdle(L, uvIdx, sockIdx, false);
+}
+
+//Closes a socket of the pool and forgets it. It's forgotten first, so forget() has nothing left to do
+inline auto Pool::drop(Lua::State* L, int uvIdx, int entryIdx, int sockIdx) noexcept -> void {
+  disown(L, uvIdx, entryIdx, sockIdx);
+  closeSocket(L, sockIdx);
+}
+
+//The socket at sockIdx is being closed by someone else than the pool: if it's one of the pool's, its place is freed
+inline auto Pool::forget(Lua::State* L, int selfIdx, int sockIdx) noexcept -> void {
+  Lua::GetUserValue(L, selfIdx);
+  const int uvIdx = Lua::GetTop(L);
+  Lua::RawGet(L, uvIdx, Owners);
+  Lua::PushValue(L, sockIdx);
+  if(Lua::RawGet(L, -2) != Lua::Types::Nil) {
+    const int entryIdx = uvIdx + 2;
+    if(isIdle(L, uvIdx, sockIdx)) {
+      removeIdle(L, entryIdx, sockIdx);
+    }
+    disown(L, uvIdx, entryIdx, sockIdx);
+    forgetIfEmpty(L, uvIdx, entryIdx);
+  }
+  Lua::SetTop(L, uvIdx - 1);
+}
+
+//acquire(addrset): an idle association to the peer, or a newly connected one.
+//Fails with "limit" if the peer already has maxPerPeer sockets handed out
+inline auto Pool::acquire(Lua::State* L) noexcept -> int {
+  auto set = Lua::Aux::CheckUData<AddressSet>(L, 2, AddressSet::MetaTableName);
+  Lua::SetTop(L, 2);
+  Lua::GetUserValue(L, 1);
+  const int uvIdx = 3;
+  pushEntry(L, uvIdx, *set, true);
+  const int entryIdx = 4;
+  Lua::RawGet(L, entryIdx, Idle);
+  Lua::RawGet(L, entryIdx, Since);
+  const int idleIdx  = 5;
+  const int sinceIdx = 6;
+  const int sockIdx  = 7;
+
+  auto time = now();
+  for(auto n = static_cast<Lua::Integer>(Lua::RawLen(L, idleIdx)); n > 0; n--) {
+    Lua::RawGet(L, idleIdx, n);
+    Lua::RawGet(L, sinceIdx, n);
+    auto since = Lua::ToInteger(L, -1);
+    Lua::Pop(L, 1);
+    Lua::PushNil(L);
+    Lua::RawSet(L, idleIdx, n);
+    Lua::PushNil(L);
+    Lua::RawSet(L, sinceIdx, n);
+    if(time - since < idleTimeout and isHealthy(ToFileDescriptor(L, sockIdx))) {
+      setIdle(L, uvIdx, sockIdx, false);
+      return 1;
+    }
+    drop(L, uvIdx, entryIdx, sockIdx);
+    Lua::Pop(L, 1);
+  }
+
+  Lua::RawGet(L, entryIdx, Count);
+  auto count = Lua::ToInteger(L, -1);
+  Lua::Pop(L, 1);
+  if(count >= maxPerPeer) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "limit");
+    return 2;
+  }
+
+  Lua::RawGet(L, uvIdx, set->addresses<4>().empty() ? NewSocket6 : NewSocket4);
+  Lua::PushInteger(L, recvBufferSize);
+  Lua::Call(L, 1, 2);
+  if(not Lua::IsUserData(L, sockIdx)) {
+    forgetIfEmpty(L, uvIdx, entryIdx);
+    return 2;
+  }
+  Lua::Pop(L, 1);
+  Lua::GetField(L, sockIdx, "connect");
+  Lua::PushValue(L, sockIdx);
+  Lua::PushValue(L, 2);
+  Lua::Call(L, 2, 2);
+  if(not Lua::ToBoolean(L, -2)) {
+    closeSocket(L, sockIdx);
+    forgetIfEmpty(L, uvIdx, entryIdx);
+    return 2;
+  }
+  Lua::SetTop(L, sockIdx);
+
+  Lua::PushInteger(L, count + 1);
+  Lua::RawSet(L, entryIdx, Count);
+  Lua::RawGet(L, uvIdx, Owners);
+  Lua::PushValue(L, sockIdx);
+  Lua::PushValue(L, entryIdx);
+  Lua::RawSet(L, -3);
+  Lua::Pop(L, 1);
+  Watch(L, sockIdx, 1);
+  return 1;
+}
+
+//release(sock [, healthy]): gives a socket back for reuse, releasing it twice is an error.
+//It's closed instead if healthy is false (e.g. a call on it failed) or it can't be reused, then false is returned
+inline auto Pool::release(Lua::State* L) noexcept -> int {
+  bool healthy = Lua::IsNoneOrNil(L, 3) or Lua::ToBoolean(L, 3);
+  Lua::SetTop(L, 2);
+  Lua::GetUserValue(L, 1);
+  const int uvIdx = 3;
+  Lua::RawGet(L, uvIdx, Owners);
+  Lua::PushValue(L, 2);
+  if(Lua::RawGet(L, -2) == Lua::Types::Nil) {
+    //Closed sockets were forgotten when they were closed
+    if(Lua::IsUserData(L, 2) and ToFileDescriptor(L, 2) < 0) {
+      Lua::PushBoolean(L, false);
+      return 1;
+    }
+    return Lua::Aux::ArgError(L, 2, "not a socket of this pool");
+  }
+  const int entryIdx = 5;
+  if(isIdle(L, uvIdx, 2)) {
+    return Lua::Aux::ArgError(L, 2, "already released");
+  }
+
+  if(not healthy or not isHealthy(ToFileDescriptor(L, 2))) {
+    drop(L, uvIdx, entryIdx, 2);
+    forgetIfEmpty(L, uvIdx, entryIdx);
+    Lua::PushBoolean(L, false);
+    return 1;
+  }
+  Lua::RawGet(L, entryIdx, Idle);
+  Lua::RawGet(L, entryIdx, Since);
+  auto n = static_cast<Lua::Integer>(Lua::RawLen(L, -2)) + 1;
+  Lua::PushValue(L, 2);
+  Lua::RawSet(L, -3, n);
+  Lua::PushInteger(L, static_cast<Lua::Integer>(now()));
+  Lua::RawSet(L, -2, n);
+  setIdle(L, uvIdx, 2, true);
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//Closes the idle sockets of every peer that have been idle for maxIdle milliseconds or are unhealthy
+inline auto Pool::expireIdle(Lua::State* L, int64_t maxIdle) noexcept -> Lua::Integer {
+  Lua::SetTop(L, 1);
+  Lua::GetUserValue(L, 1);
+  const int uvIdx = 2;
+  Lua::RawGet(L, uvIdx, Peers);
+  auto time = now();
+  Lua::Integer closed = 0;
+  Lua::PushNil(L);
+  while(Lua::Next(L, 3) != 0) {
+    const int entryIdx = 5;
+    Lua::RawGet(L, entryIdx, Idle);
+    Lua::RawGet(L, entryIdx, Since);
+    const int idleIdx  = 6;
+    const int sinceIdx = 7;
+    auto n = static_cast<Lua::Integer>(Lua::RawLen(L, idleIdx));
+    Lua::Integer kept = 0;
+    for(Lua::Integer i = 1; i <= n; i++) {
+      Lua::RawGet(L, idleIdx, i);
+      Lua::RawGet(L, sinceIdx, i);
+      const int sockIdx = 8;
+      if(time - Lua::ToInteger(L, -1) < maxIdle and isHealthy(ToFileDescriptor(L, sockIdx))) {
+        kept++;
+        Lua::RawSet(L, sinceIdx, kept);
+        Lua::RawSet(L, idleIdx, kept);
+        continue;
+      }
+      Lua::Pop(L, 1);
+      drop(L, uvIdx, entryIdx, sockIdx);
+      Lua::Pop(L, 1);
+      closed++;
+    }
+    for(Lua::Integer i = kept + 1; i <= n; i++) {
+      Lua::PushNil(L);
+      Lua::RawSet(L, idleIdx, i);
+      Lua::PushNil(L);
+      Lua::RawSet(L, sinceIdx, i);
+    }
+    //Clearing the current key is allowed while traversing
+    forgetIfEmpty(L, uvIdx, entryIdx);
+    Lua::SetTop(L, 4);
+  }
+  return closed;
+}
+
+//expire(): closes the sockets idle for longer than the idle timeout, returns their number
+inline auto Pool::expire(Lua::State* L) noexcept -> int {
+  Lua::PushInteger(L, expireIdle(L, idleTimeout));
+  return 1;
+}
+
+//close(): closes every idle socket, returns their number
+inline auto Pool::close(Lua::State* L) noexcept -> int {
+  Lua::PushInteger(L, expireIdle(L, 0));
+  return 1;
+}
+
+//size(addrset): the number of sockets of the peer and how many of them are idle
+inline auto Pool::size(Lua::State* L) noexcept -> int {
+  auto set = Lua::Aux::CheckUData<AddressSet>(L, 2, AddressSet::MetaTableName);
+  Lua::SetTop(L, 2);
+  Lua::GetUserValue(L, 1);
+  pushEntry(L, 3, *set, false);
+  if(Lua::IsNil(L, 4)) {
+    Lua::PushInteger(L, 0);
+    Lua::PushInteger(L, 0);
+    return 2;
+  }
+  Lua::RawGet(L, 4, Count);
+  Lua::RawGet(L, 4, Idle);
+  Lua::PushInteger(L, static_cast<Lua::Integer>(Lua::RawLen(L, -1)));
+  Lua::Replace(L, -2);
+  return 2;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPPOOL_HPP */
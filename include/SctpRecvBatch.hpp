@@ -0,0 +1,144 @@
+#ifndef SCTPRECVBATCH_HPP
+#define SCTPRECVBATCH_HPP
+
+#include <memory>
+#include <new>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/sctp.h>
+
+#include "SctpRecvBuffer.hpp"
+#include "SctpRecvInfo.hpp"
+
+namespace Sctp {
+
+//Slots for receiving several messages with a single recvmmsg() call.
+//Nothing is allocated until the first batch is received
+class RecvBatch {
+public:
+  //recvmmsg() doesn't take more than UIO_MAXIOV messages at once
+  static constexpr std::size_t MaxMessages = 1024;
+  static constexpr std::size_t DefaultMessages = 64;
+  static constexpr std::size_t ControlSize = RecvInfo::ControlSize;
+private:
+  std::unique_ptr<mmsghdr[]> headers;
+  std::unique_ptr<iovec[]> iovs;
+  std::unique_ptr<char[]> controls;
+  std::unique_ptr<char[]> storage;
+  std::size_t slotCount;
+  std::size_t slotSize;
+public:
+  RecvBatch() noexcept : slotCount(0), slotSize(0) {}
+public:
+  template<class Handler>
+  auto receive(int fd, RecvBuffer& partial, std::size_t count, Handler&& handler) noexcept -> int;
+private:
+  auto prepare(std::size_t count, std::size_t size) noexcept -> bool;
+  auto slot(std::size_t i) const noexcept -> const char* { return storage.get() + i * slotSize; }
+};
+
+inline auto RecvBatch::prepare(std::size_t count, std::size_t size) noexcept -> bool {
+  if(count > slotCount or size != slotSize) {
+    std::size_t newCount = count > slotCount ? count : slotCount;
+    std::unique_ptr<mmsghdr[]> newHeaders(new (std::nothrow) mmsghdr[newCount]);
+    std::unique_ptr<iovec[]> newIovs(new (std::nothrow) iovec[newCount]);
+    std::unique_ptr<char[]> newControls(new (std::nothrow) char[newCount * ControlSize]);
+    std::unique_ptr<char[]> newStorage(new (std::nothrow) char[newCount * size]);
+    if(newHeaders == nullptr or newIovs == nullptr or newControls == nullptr or newStorage == nullptr) {
+      return false;
+    }
+    headers   = std::move(newHeaders);
+    iovs      = std::move(newIovs);
+    controls  = std::move(newControls);
+    storage   = std::move(newStorage);
+    slotCount = newCount;
+    slotSize  = size;
+  }
+
+  //The kernel overwrites the lengths and flags, so every slot has to be reset before each call
+  for(std::size_t i = 0; i < count; i++) {
+    iovs[i].iov_base = storage.get() + i * slotSize;
+    iovs[i].iov_len  = slotSize;
+    std::memset(&headers[i], 0, sizeof(mmsghdr));
+    headers[i].msg_hdr.msg_iov        = &iovs[i];
+    headers[i].msg_hdr.msg_iovlen     = 1;
+    headers[i].msg_hdr.msg_control    = controls.get() + i * ControlSize;
+    headers[i].msg_hdr.msg_controllen = ControlSize;
+  }
+  return true;
+}
+
+//Calls handler(data, length, msghdr) for every complete message and returns their number,
+//or -1 with errno set if nothing could be received.
+//Messages split over several slots are put together in the socket's own receive buffer
+//(also the ones whose pieces interleave, see RecvBuffer), a message that is still incomplete at the end
+//is left there for the next call
+template<class Handler>
+auto RecvBatch::receive(int fd, RecvBuffer& partial, std::size_t count, Handler&& handler) noexcept -> int {
+  char control[ControlSize];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_control    = control;
+  msg.msg_controllen = ControlSize;
+
+  if(partial.pending() > 0) {
+    if(partial.receive(fd, msg) < 0) {
+      return -1;
+    }
+    handler(partial.data(), partial.pending(), msg);
+    partial.clear();
+    return 1;
+  }
+
+  if(not prepare(count, partial.size() == 0 ? RecvBuffer::DefaultSize : partial.size())) {
+    errno = ENOMEM;
+    return -1;
+  }
+  int numReceived = ::recvmmsg(fd, headers.get(), count, MSG_WAITFORONE, nullptr);
+  if(numReceived < 0) {
+    return -1;
+  }
+
+  int numMessages = 0;
+  for(int i = 0; i < numReceived; i++) {
+    const auto& header   = headers[i].msg_hdr;
+    const auto length    = headers[i].msg_len;
+    const bool  complete = length == 0 or (header.msg_flags & MSG_EOR);
+    if(complete and partial.pending() == 0 and not partial.interleaved()) {
+      handler(slot(i), length, header);
+      numMessages++;
+      continue;
+    }
+    int placed = partial.add(slot(i), length, header);
+    if(placed < 0) {
+      partial.clear();
+      errno = ENOMEM;
+      return numMessages > 0 ? numMessages : -1;
+    }
+    if(placed > 0) {
+      handler(partial.data(), partial.pending(), header);
+      partial.clear();
+      numMessages++;
+    }
+  }
+
+  if(partial.pending() > 0) {
+    msg.msg_controllen = ControlSize;
+    if(partial.receive(fd, msg) >= 0) {
+      handler(partial.data(), partial.pending(), msg);
+      partial.clear();
+      numMessages++;
+    } else if(numMessages == 0) {
+      return -1;
+    }
+  }
+  return numMessages;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPRECVBATCH_HPP */
@@ -0,0 +1,199 @@
+#ifndef SCTPRECVBUFFER_HPP
+#define SCTPRECVBUFFER_HPP
+
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "SctpRecvInfo.hpp"
+
+namespace Sctp {
+
+//Receive buffer of a message oriented socket.
+//Grows on demand, so a message is always handed over in one piece,
+//and keeps the already received part of a message if the rest isn't there yet.
+//With fragment_interleave the pieces of messages of different associations or streams may arrive in turn:
+//the ones of other messages than the buffered one are put aside by (assoc_id, stream) until their message is complete
+class RecvBuffer {
+public:
+  static constexpr std::size_t DefaultSize = 5000;
+private:
+  std::unique_ptr<char[]> buffer;
+  std::size_t capacity;
+  std::size_t length;
+  //(assoc_id, stream) of the buffered message, while there is one
+  uint64_t key;
+  std::unordered_map<uint64_t, std::unique_ptr<RecvBuffer>> interrupted;
+public:
+  RecvBuffer(std::size_t size = DefaultSize) noexcept;
+public:
+  auto data() const noexcept -> const char* { return buffer.get(); }
+  auto size() const noexcept -> std::size_t { return capacity; }
+  auto pending() const noexcept -> std::size_t { return length; }
+  auto interleaved() const noexcept -> bool { return not interrupted.empty(); }
+  auto clear() noexcept -> void { length = 0; }
+  auto resize(std::size_t newSize) noexcept -> bool;
+  auto append(const char* data, std::size_t dataLength) noexcept -> bool;
+  auto add(const char* data, std::size_t dataLength, const msghdr& msg) noexcept -> int;
+  auto receive(int fd, msghdr& msg) noexcept -> ssize_t;
+  auto finish(int fd, const char* head, std::size_t headLength, msghdr& msg) noexcept -> ssize_t;
+private:
+  auto reserve(std::size_t dataLength) noexcept -> bool;
+  auto place(std::size_t pieceLength, const msghdr& msg) noexcept -> int;
+  static auto keyOf(const msghdr&) noexcept -> uint64_t;
+};
+
+inline RecvBuffer::RecvBuffer(std::size_t size) noexcept : buffer(new (std::nothrow) char[size]), capacity(size), length(0), key(0) {
+  if(buffer == nullptr) {
+    capacity = 0;
+  }
+}
+
+//Notifications have no SCTP_RCVINFO, they get a key of their own
+inline auto RecvBuffer::keyOf(const msghdr& msg) noexcept -> uint64_t {
+  if(msg.msg_flags & MSG_NOTIFICATION) {
+    return UINT64_MAX;
+  }
+  auto info = RecvInfo::find(msg);
+  return info == nullptr ? 0 : static_cast<uint64_t>(static_cast<uint32_t>(info->rcv_assoc_id)) << 16 | info->rcv_sid;
+}
+
+inline auto RecvBuffer::resize(std::size_t newSize) noexcept -> bool {
+  if(newSize < length or newSize == 0) {
+    return false;
+  }
+  std::unique_ptr<char[]> newBuffer(new (std::nothrow) char[newSize]);
+  if(newBuffer == nullptr) {
+    return false;
+  }
+  std::memcpy(newBuffer.get(), buffer.get(), length);
+  buffer   = std::move(newBuffer);
+  capacity = newSize;
+  return true;
+}
+
+//Makes room for dataLength more bytes
+inline auto RecvBuffer::reserve(std::size_t dataLength) noexcept -> bool {
+  std::size_t newCapacity = capacity == 0 ? DefaultSize : capacity;
+  while(newCapacity - length < dataLength) {
+    newCapacity *= 2;
+  }
+  return newCapacity == capacity or resize(newCapacity);
+}
+
+inline auto RecvBuffer::append(const char* data, std::size_t dataLength) noexcept -> bool {
+  if(not reserve(dataLength)) {
+    return false;
+  }
+  std::memcpy(buffer.get() + length, data, dataLength);
+  length += dataLength;
+  return true;
+}
+
+//Takes the piece received right after the buffered data (pieceLength bytes at data() + pending()).
+//Returns 1 if a message is complete in the buffer, 0 if not yet, -1 if a piece couldn't be put aside
+inline auto RecvBuffer::place(std::size_t pieceLength, const msghdr& msg) noexcept -> int {
+  if(pieceLength == 0) {
+    //End of file, what's buffered is all there is
+    return 1;
+  }
+  const bool complete = msg.msg_flags & MSG_EOR;
+  const auto pieceKey = keyOf(msg);
+  auto other = interrupted.empty() ? interrupted.end() : interrupted.find(pieceKey);
+  if(length > 0 ? pieceKey == key : other == interrupted.end()) {
+    key     = pieceKey;
+    length += pieceLength;
+    return complete ? 1 : 0;
+  }
+
+  //The piece goes with the earlier pieces of its message
+  if(other == interrupted.end()) {
+    other = interrupted.emplace(pieceKey, std::unique_ptr<RecvBuffer>(new (std::nothrow) RecvBuffer(0))).first;
+  }
+  if(other->second == nullptr or not other->second->append(buffer.get() + length, pieceLength)) {
+    return -1;
+  }
+  if(length > 0 and not complete) {
+    return 0;
+  }
+  //That message is buffered from now on, the one it interrupted (if any) is put aside instead
+  auto aside = std::move(other->second);
+  interrupted.erase(other);
+  std::swap(buffer, aside->buffer);
+  std::swap(capacity, aside->capacity);
+  std::swap(length, aside->length);
+  if(aside->length > 0) {
+    interrupted.emplace(key, std::move(aside));
+  }
+  key = pieceKey;
+  return complete ? 1 : 0;
+}
+
+//Adds a piece received elsewhere (msg is its header), returns as place()
+inline auto RecvBuffer::add(const char* data, std::size_t dataLength, const msghdr& msg) noexcept -> int {
+  if(not reserve(dataLength)) {
+    return -1;
+  }
+  std::memcpy(buffer.get() + length, data, dataLength);
+  return place(dataLength, msg);
+}
+
+//Returns the size of the complete message, or -1 with errno set.
+//The caller provides the control buffer in msg (if any), the data buffer is ours.
+//Unless it fails, the message has to be consumed with clear() before the next call
+inline auto RecvBuffer::receive(int fd, msghdr& msg) noexcept -> ssize_t {
+  const auto controlLength = msg.msg_controllen;
+  iovec iov;
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
+  for(;;) {
+    if(length == capacity and not resize(capacity == 0 ? DefaultSize : capacity * 2)) {
+      errno = ENOMEM;
+      return -1;
+    }
+    iov.iov_base       = buffer.get() + length;
+    iov.iov_len        = capacity - length;
+    msg.msg_controllen = controlLength;
+    msg.msg_flags      = 0;
+
+    ssize_t numBytesReceived = ::recvmsg(fd, &msg, 0);
+    if(numBytesReceived < 0) {
+      //Whatever arrived so far is kept for the next call
+      return -1;
+    }
+    int placed = place(numBytesReceived, msg);
+    if(placed < 0) {
+      errno = ENOMEM;
+      return -1;
+    }
+    if(placed > 0) {
+      return length;
+    }
+  }
+}
+
+//Like receive(), for a message whose first piece was received elsewhere (into a Buffer by recv_into).
+//msg is the header of that piece, its control buffer has room for RecvInfo::ControlSize bytes
+inline auto RecvBuffer::finish(int fd, const char* head, std::size_t headLength, msghdr& msg) noexcept -> ssize_t {
+  int placed = add(head, headLength, msg);
+  if(placed < 0) {
+    errno = ENOMEM;
+    return -1;
+  }
+  if(placed > 0) {
+    return length;
+  }
+  msg.msg_controllen = RecvInfo::ControlSize;
+  return receive(fd, msg);
+}
+
+} //namespace Sctp
+
+#endif /* SCTPRECVBUFFER_HPP */
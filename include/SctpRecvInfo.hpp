@@ -0,0 +1,56 @@
+#ifndef SCTPRECVINFO_HPP
+#define SCTPRECVINFO_HPP
+
+#include <sys/socket.h>
+#include <netinet/sctp.h>
+
+#include "Lua/Lua.hpp"
+
+namespace Sctp {
+
+//SCTP_RCVINFO ancillary data of an incoming message (enabled by SCTP_RECVRCVINFO on every socket)
+class RecvInfo {
+public:
+  static constexpr std::size_t ControlSize = CMSG_SPACE(sizeof(sctp_rcvinfo));
+public:
+  static auto find(const msghdr&) noexcept -> const sctp_rcvinfo*;
+  static auto store(Lua::State*, const msghdr&, int tableIdx) noexcept -> void;
+};
+
+inline auto RecvInfo::find(const msghdr& msg) noexcept -> const sctp_rcvinfo* {
+  for(auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), cmsg)) {
+    if(cmsg->cmsg_level == IPPROTO_SCTP and cmsg->cmsg_type == SCTP_RCVINFO) {
+      return reinterpret_cast<const sctp_rcvinfo*>(CMSG_DATA(cmsg));
+    }
+  }
+  return nullptr;
+}
+
+//Fills a caller supplied table, so the hot path doesn't have to allocate one per message
+inline auto RecvInfo::store(Lua::State* L, const msghdr& msg, int tableIdx) noexcept -> void {
+  sctp_rcvinfo empty = {};
+  auto info = find(msg);
+  if(info == nullptr) {
+    info = &empty;
+  }
+  Lua::PushInteger(L, info->rcv_sid);
+  Lua::SetField(L, tableIdx, "stream");
+  Lua::PushInteger(L, info->rcv_ssn);
+  Lua::SetField(L, tableIdx, "ssn");
+  Lua::PushInteger(L, info->rcv_flags);
+  Lua::SetField(L, tableIdx, "flags");
+  Lua::PushInteger(L, info->rcv_ppid);
+  Lua::SetField(L, tableIdx, "ppid");
+  Lua::PushInteger(L, info->rcv_tsn);
+  Lua::SetField(L, tableIdx, "tsn");
+  Lua::PushInteger(L, info->rcv_cumtsn);
+  Lua::SetField(L, tableIdx, "cumtsn");
+  Lua::PushInteger(L, info->rcv_context);
+  Lua::SetField(L, tableIdx, "context");
+  Lua::PushInteger(L, info->rcv_assoc_id);
+  Lua::SetField(L, tableIdx, "assoc_id");
+}
+
+} //namespace Sctp
+
+#endif /* SCTPRECVINFO_HPP */
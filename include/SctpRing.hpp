@@ -0,0 +1,81 @@
+#ifndef SCTPRING_HPP
+#define SCTPRING_HPP
+
+#include <memory>
+#include <new>
+#include <atomic>
+#include <cstddef>
+
+namespace Sctp {
+
+//Bounded lock-free queue between exactly one producer and one consumer thread.
+//The capacity is rounded up to a power of two
+template<class T>
+class Ring {
+  //Keeps the producer's and the consumer's index on different cache lines
+  static constexpr std::size_t CacheLineSize = 64;
+private:
+  std::unique_ptr<T[]> slots;
+  std::size_t mask;
+  std::atomic<std::size_t> head;
+  char headPadding[CacheLineSize - sizeof(std::atomic<std::size_t>)];
+  std::atomic<std::size_t> tail;
+  char tailPadding[CacheLineSize - sizeof(std::atomic<std::size_t>)];
+public:
+  Ring(std::size_t capacity) noexcept;
+public:
+  auto valid() const noexcept -> bool { return slots != nullptr; }
+  auto capacity() const noexcept -> std::size_t { return mask + 1; }
+  //Only called by the producer
+  auto push(T&& value) noexcept -> bool;
+  //Only called by the consumer
+  auto pop(T& value) noexcept -> bool;
+  auto empty() const noexcept -> bool;
+  auto full() const noexcept -> bool;
+};
+
+template<class T>
+Ring<T>::Ring(std::size_t capacity) noexcept : mask(0), head(0), tail(0) {
+  std::size_t size = 1;
+  while(size < capacity) {
+    size <<= 1;
+  }
+  slots.reset(new (std::nothrow) T[size]);
+  mask = size - 1;
+}
+
+template<class T>
+auto Ring<T>::push(T&& value) noexcept -> bool {
+  auto t = tail.load(std::memory_order_relaxed);
+  if(t - head.load(std::memory_order_acquire) > mask) {
+    return false;
+  }
+  slots[t & mask] = std::move(value);
+  tail.store(t + 1, std::memory_order_release);
+  return true;
+}
+
+template<class T>
+auto Ring<T>::pop(T& value) noexcept -> bool {
+  auto h = head.load(std::memory_order_relaxed);
+  if(h == tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+  value = std::move(slots[h & mask]);
+  head.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+template<class T>
+auto Ring<T>::empty() const noexcept -> bool {
+  return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+template<class T>
+auto Ring<T>::full() const noexcept -> bool {
+  return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire) > mask;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPRING_HPP */
@@ -0,0 +1,336 @@
+#ifndef SCTPSCHEDULER_HPP
+#define SCTPSCHEDULER_HPP
+
+#include <cstring>
+#include <cerrno>
+#include <initializer_list>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpSocket.hpp"
+
+namespace Sctp {
+
+//Runs coroutines (tasks) and resumes the ones blocked on a socket when epoll says it's ready.
+//Socket methods called from a task yield (fd, events) to the scheduler instead of returning EAGAIN,
+//and a plain coroutine.yield() just gives the other tasks a turn. Closing a socket wakes its waiting tasks,
+//so the call they're in fails instead of waiting for good.
+//The user value holds the queue of runnable tasks and the waiting ones (fd -> task or array of tasks)
+class Scheduler {
+public:
+  static const char* MetaTableName;
+  static constexpr int MaxEvents = 256;
+  static constexpr uint32_t Read  = EPOLLIN;
+  static constexpr uint32_t Write = EPOLLOUT;
+private:
+  enum Slots : Lua::Integer { Ready = 1, Readers = 2, Writers = 3 };
+  //Addresses used as light userdata keys: the registry table of every task and the mark of our yields
+  static const char TasksKey;
+  static const char YieldMark;
+private:
+  int epollFD;
+  int waiting;
+  epoll_event events[MaxEvents];
+public:
+  Scheduler() noexcept : epollFD(-1), waiting(0) {}
+  ~Scheduler();
+public:
+  auto create(Lua::State*) noexcept -> bool;
+  auto spawn(Lua::State*) noexcept -> int;
+  auto run(Lua::State*) noexcept -> int;
+public:
+  static auto isTask(Lua::State*) noexcept -> bool;
+  static auto yield(Lua::State*, int sockIdx, int fd, uint32_t events, Lua::KFunction) noexcept -> int;
+  auto forget(Lua::State*, int selfIdx, int fd) noexcept -> void;
+private:
+  auto resume(Lua::State* L, Lua::State* task) noexcept -> bool;
+  auto wait(Lua::State* L, int fd, uint32_t events) noexcept -> void;
+  auto wake(Lua::State* L, int selfIdx, int fd, uint32_t events) noexcept -> void;
+  static auto append(Lua::State* L, int tableIdx) noexcept -> void;
+};
+
+inline Scheduler::~Scheduler() {
+  if(epollFD > -1) {
+    ::close(epollFD);
+  }
+}
+
+//Expects the scheduler on the top of the stack, sets up its user value
+inline auto Scheduler::create(Lua::State* L) noexcept -> bool {
+  epollFD = ::epoll_create1(EPOLL_CLOEXEC);
+  if(epollFD < 0) {
+    return false;
+  }
+  Lua::CreateTable(L, 3, 0);
+  for(Lua::Integer slot = Ready; slot <= Writers; slot++) {
+    Lua::Newtable(L);
+    Lua::RawSet(L, -2, slot);
+  }
+  Lua::SetUserValue(L, -2);
+
+  if(Lua::RawGet(L, Lua::RegistryIndex, &TasksKey) == Lua::Types::Nil) {
+    Lua::Newtable(L);
+    Lua::CreateTable(L, 0, 1);
+    Lua::PushString(L, "k");
+    Lua::SetField(L, -2, "__mode");
+    Lua::SetMetaTable(L, -2);
+    Lua::RawSet(L, Lua::RegistryIndex, &TasksKey);
+  }
+  Lua::Pop(L, 1);
+  return true;
+}
+
+//Whether the running coroutine was started by a scheduler, only checked when a call would block
+inline auto Scheduler::isTask(Lua::State* L) noexcept -> bool {
+  if(not Lua::IsYieldable(L)) {
+    return false;
+  }
+  if(Lua::RawGet(L, Lua::RegistryIndex, &TasksKey) == Lua::Types::Nil) {
+    Lua::Pop(L, 1);
+    return false;
+  }
+  Lua::PushThread(L);
+  bool result = Lua::RawGet(L, -2) != Lua::Types::Nil;
+  Lua::Pop(L, 2);
+  return result;
+}
+
+//The stack has to be the same as when the yielding function was called, k is called with it when the task is resumed.
+//The socket at sockIdx is the one fd belongs to, the scheduler watches it while the task waits
+inline auto Scheduler::yield(Lua::State* L, int sockIdx, int fd, uint32_t events, Lua::KFunction k) noexcept -> int {
+  sockIdx = Lua::AbsIndex(L, sockIdx);
+  Lua::PushLightUserData(L, const_cast<char*>(&YieldMark));
+  Lua::PushInteger(L, fd);
+  Lua::PushInteger(L, events);
+  Lua::PushValue(L, sockIdx);
+  return Lua::YieldK(L, 4, 0, k);
+}
+
+//Appends the value on the top of the stack to the array at tableIdx
+inline auto Scheduler::append(Lua::State* L, int tableIdx) noexcept -> void {
+  Lua::RawSet(L, tableIdx, static_cast<Lua::Integer>(Lua::RawLen(L, tableIdx) + 1));
+}
+
+//spawn(fn, ...): the task starts at the next run(), returns the coroutine
+inline auto Scheduler::spawn(Lua::State* L) noexcept -> int {
+  Lua::Aux::CheckType(L, 2, static_cast<int>(Lua::Types::Function));
+  int numArgs = Lua::GetTop(L) - 1;
+  auto task   = Lua::NewThread(L);
+  for(int i = 2; i <= numArgs + 1; i++) {
+    Lua::PushValue(L, i);
+  }
+  Lua::XMove(L, task, numArgs);
+
+  Lua::RawGet(L, Lua::RegistryIndex, &TasksKey);
+  Lua::PushValue(L, -2);
+  Lua::PushBoolean(L, true);
+  Lua::RawSet(L, -3);
+  Lua::Pop(L, 1);
+
+  Lua::GetUserValue(L, 1);
+  Lua::RawGet(L, -1, static_cast<Lua::Integer>(Ready));
+  Lua::PushValue(L, -3);
+  append(L, Lua::GetTop(L) - 1);
+  Lua::Pop(L, 2);
+  return 1;
+}
+
+//Runs the task at the top of L's stack until it yields or ends, false if it raised an error (left on L's stack)
+inline auto Scheduler::resume(Lua::State* L, Lua::State* task) noexcept -> bool {
+  //A task that hasn't started yet has its function and arguments on its stack
+  int numArgs   = Lua::Status(task) == Lua::Statuses::OK ? Lua::GetTop(task) - 1 : 0;
+  auto status   = Lua::Resume(task, L, numArgs);
+  if(status == Lua::Statuses::OK) {
+    Lua::SetTop(task, 0);
+    return true;
+  }
+  if(status != Lua::Statuses::Yield) {
+    Lua::XMove(task, L, 1);
+    return false;
+  }
+
+  if(Lua::GetTop(task) == 4 and Lua::ToUserData(task, 1) == &YieldMark) {
+    int fd      = static_cast<int>(Lua::ToInteger(task, 2));
+    auto events = static_cast<uint32_t>(Lua::ToInteger(task, 3));
+    Lua::XMove(task, L, 1);
+    Lua::SetTop(task, 0);
+    wait(L, fd, events);
+  } else {
+    Lua::SetTop(task, 0);
+    Lua::GetUserValue(L, 1);
+    Lua::RawGet(L, -1, static_cast<Lua::Integer>(Ready));
+    Lua::PushValue(L, -3);
+    append(L, Lua::GetTop(L) - 1);
+    Lua::Pop(L, 2);
+  }
+  return true;
+}
+
+//Parks the task below the top of L's stack until fd (of the socket at the top) is ready for events.
+//The fd is registered one-shot, with the union of what its readers and writers wait for;
+//if that fails, the tasks waiting on it are woken right away and their calls find out why
+inline auto Scheduler::wait(Lua::State* L, int fd, uint32_t events) noexcept -> void {
+  Watch(L, -1, 1);
+  int taskIdx = Lua::GetTop(L) - 1;
+  int uvIdx   = taskIdx + 2;
+  Lua::GetUserValue(L, 1);
+  Lua::RawGet(L, -1, static_cast<Lua::Integer>(events == Read ? Readers : Writers));
+  switch(Lua::RawGet(L, -1, static_cast<Lua::Integer>(fd))) {
+  case Lua::Types::Nil:
+    Lua::PushValue(L, taskIdx);
+    Lua::RawSet(L, -3, static_cast<Lua::Integer>(fd));
+    break;
+  case Lua::Types::Thread:
+    //More than one task waits for the same thing, they're kept in an array and woken together
+    Lua::CreateTable(L, 2, 0);
+    Lua::Insert(L, -2);
+    Lua::RawSet(L, -2, 1);
+    Lua::PushValue(L, taskIdx);
+    Lua::RawSet(L, -2, 2);
+    Lua::RawSet(L, -2, static_cast<Lua::Integer>(fd));
+    Lua::PushNil(L);
+    break;
+  default:
+    Lua::PushValue(L, taskIdx);
+    append(L, Lua::GetTop(L) - 1);
+    break;
+  }
+  waiting++;
+
+  epoll_event ev;
+  std::memset(&ev, 0, sizeof(epoll_event));
+  ev.data.fd = fd;
+  ev.events  = EPOLLONESHOT | EPOLLRDHUP;
+  Lua::RawGet(L, uvIdx, static_cast<Lua::Integer>(Readers));
+  if(Lua::RawGet(L, -1, static_cast<Lua::Integer>(fd)) != Lua::Types::Nil) {
+    ev.events |= Read;
+  }
+  Lua::RawGet(L, uvIdx, static_cast<Lua::Integer>(Writers));
+  if(Lua::RawGet(L, -1, static_cast<Lua::Integer>(fd)) != Lua::Types::Nil) {
+    ev.events |= Write;
+  }
+  int result = ::epoll_ctl(epollFD, EPOLL_CTL_MOD, fd, &ev);
+  if(result < 0 and errno == ENOENT) {
+    result = ::epoll_ctl(epollFD, EPOLL_CTL_ADD, fd, &ev);
+  }
+  Lua::SetTop(L, taskIdx);
+  if(result < 0) {
+    wake(L, 1, fd, EPOLLERR);
+  }
+}
+
+//Moves the tasks waiting on fd for any of events to the ready queue, then re-arms the fd for the rest
+inline auto Scheduler::wake(Lua::State* L, int selfIdx, int fd, uint32_t events) noexcept -> void {
+  Lua::GetUserValue(L, selfIdx);
+  int uvIdx = Lua::GetTop(L);
+  Lua::RawGet(L, uvIdx, static_cast<Lua::Integer>(Ready));
+  int readyIdx = Lua::GetTop(L);
+
+  uint32_t remaining = 0;
+  for(auto slot : { Readers, Writers }) {
+    const uint32_t slotEvents = slot == Readers ? (Read | EPOLLRDHUP) : Write;
+    Lua::RawGet(L, uvIdx, static_cast<Lua::Integer>(slot));
+    auto type = Lua::RawGet(L, -1, static_cast<Lua::Integer>(fd));
+    if(type == Lua::Types::Nil) {
+      Lua::Pop(L, 2);
+      continue;
+    }
+    if((events & (slotEvents | EPOLLERR | EPOLLHUP)) == 0) {
+      remaining |= slot == Readers ? Read : Write;
+      Lua::Pop(L, 2);
+      continue;
+    }
+    if(type == Lua::Types::Thread) {
+      append(L, readyIdx);
+      waiting--;
+    } else {
+      for(Lua::Integer i = 1; Lua::RawGet(L, -1, i) != Lua::Types::Nil; i++) {
+        append(L, readyIdx);
+        waiting--;
+      }
+      Lua::Pop(L, 2);
+    }
+    Lua::PushNil(L);
+    Lua::RawSet(L, -2, static_cast<Lua::Integer>(fd));
+    Lua::Pop(L, 1);
+  }
+  Lua::SetTop(L, uvIdx - 1);
+
+  if(remaining != 0) {
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(epoll_event));
+    ev.data.fd = fd;
+    ev.events  = remaining | EPOLLONESHOT | EPOLLRDHUP;
+    ::epoll_ctl(epollFD, EPOLL_CTL_MOD, fd, &ev);
+  }
+}
+
+//The socket of fd is about to close it: its tasks are woken (their calls fail on the closed socket)
+//and the fd is dropped, so a socket reusing it starts over
+inline auto Scheduler::forget(Lua::State* L, int selfIdx, int fd) noexcept -> void {
+  epoll_event ev;
+  std::memset(&ev, 0, sizeof(epoll_event));
+  ::epoll_ctl(epollFD, EPOLL_CTL_DEL, fd, &ev);
+  wake(L, Lua::AbsIndex(L, selfIdx), fd, EPOLLERR);
+}
+
+//run([timeout]): runs the tasks until all of them are done (true) or none could continue
+//within timeout milliseconds (false, "timeout"). An error in a task stops it, run returns false and the error,
+//the other tasks are kept and continue with the next run()
+inline auto Scheduler::run(Lua::State* L) noexcept -> int {
+  int timeout = static_cast<int>(Lua::Aux::OptInteger(L, 2, -1));
+  Lua::SetTop(L, 1);
+  Lua::GetUserValue(L, 1);
+
+  while(true) {
+    //Tasks made ready while running this batch go to a new queue
+    Lua::RawGet(L, 2, static_cast<Lua::Integer>(Ready));
+    Lua::Newtable(L);
+    Lua::RawSet(L, 2, static_cast<Lua::Integer>(Ready));
+    auto numReady = static_cast<Lua::Integer>(Lua::RawLen(L, 3));
+    for(Lua::Integer i = 1; i <= numReady; i++) {
+      Lua::RawGet(L, 3, i);
+      if(not resume(L, Lua::ToThread(L, 4))) {
+        Lua::RawGet(L, 2, static_cast<Lua::Integer>(Ready));
+        for(Lua::Integer j = i + 1; j <= numReady; j++) {
+          Lua::RawGet(L, 3, j);
+          append(L, 6);
+        }
+        Lua::PushBoolean(L, false);
+        Lua::PushValue(L, 5);
+        return 2;
+      }
+      Lua::SetTop(L, 3);
+    }
+    Lua::Pop(L, 1);
+
+    Lua::RawGet(L, 2, static_cast<Lua::Integer>(Ready));
+    bool haveReady = Lua::RawLen(L, -1) > 0;
+    Lua::Pop(L, 1);
+    if(not haveReady and waiting == 0) {
+      Lua::PushBoolean(L, true);
+      return 1;
+    }
+
+    int numEvents = ::epoll_wait(epollFD, events, MaxEvents, haveReady ? 0 : timeout);
+    if(numEvents < 0 and errno != EINTR) {
+      Lua::PushBoolean(L, false);
+      Lua::PushFString(L, "epoll_wait: %s", std::strerror(errno));
+      return 2;
+    }
+    if(numEvents == 0 and not haveReady) {
+      Lua::PushBoolean(L, false);
+      Lua::PushString(L, "timeout");
+      return 2;
+    }
+    for(int i = 0; i < numEvents; i++) {
+      wake(L, 1, events[i].data.fd, events[i].events);
+    }
+  }
+}
+
+} //namespace Sctp
+
+#endif /* SCTPSCHEDULER_HPP */
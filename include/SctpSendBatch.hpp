@@ -0,0 +1,145 @@
+#ifndef SCTPSENDBATCH_HPP
+#define SCTPSENDBATCH_HPP
+
+#include <memory>
+#include <new>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/sctp.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpSendInfo.hpp"
+
+namespace Sctp {
+
+//Slots for sending several messages with a single sendmmsg() call,
+//each of them carrying its own SCTP_SNDINFO
+class SendBatch {
+public:
+  //sendmmsg() doesn't take more than UIO_MAXIOV messages at once
+  static constexpr std::size_t MaxMessages = 1024;
+  static constexpr std::size_t ControlSize = SendInfo::ControlSize;
+private:
+  std::unique_ptr<mmsghdr[]> headers;
+  std::unique_ptr<iovec[]> iovs;
+  std::unique_ptr<char[]> controls;
+  std::size_t slotCount;
+public:
+  SendBatch() noexcept : slotCount(0) {}
+public:
+  template<class SendMmsg>
+  auto send(Lua::State*, int msgsIdx, sctp_assoc_t assocId, bool& blocked, SendMmsg&& sendmmsg) noexcept -> int;
+private:
+  auto reserve(std::size_t count) noexcept -> bool;
+  auto load(Lua::State*, std::size_t slot, int entryIdx, sctp_assoc_t assocId) noexcept -> bool;
+};
+
+inline auto SendBatch::reserve(std::size_t count) noexcept -> bool {
+  if(count <= slotCount) {
+    return true;
+  }
+  std::unique_ptr<mmsghdr[]> newHeaders(new (std::nothrow) mmsghdr[count]);
+  std::unique_ptr<iovec[]> newIovs(new (std::nothrow) iovec[count]);
+  std::unique_ptr<char[]> newControls(new (std::nothrow) char[count * ControlSize]);
+  if(newHeaders == nullptr or newIovs == nullptr or newControls == nullptr) {
+    return false;
+  }
+  headers   = std::move(newHeaders);
+  iovs      = std::move(newIovs);
+  controls  = std::move(newControls);
+  slotCount = count;
+  return true;
+}
+
+//An entry is either the payload itself or {payload, stream, ppid, flags, assocId}
+inline auto SendBatch::load(Lua::State* L, std::size_t slot, int entryIdx, sctp_assoc_t assocId) noexcept -> bool {
+  SendInfo info(assocId);
+
+  std::size_t length = 0;
+  const char* payload = nullptr;
+  if(Lua::IsTable(L, entryIdx)) {
+    if(Lua::RawGet(L, entryIdx, 1) == Lua::Types::String) {
+      payload = Lua::ToLString(L, -1, &length);
+    }
+    Lua::RawGet(L, entryIdx, 2);
+    Lua::RawGet(L, entryIdx, 3);
+    Lua::RawGet(L, entryIdx, 4);
+    Lua::RawGet(L, entryIdx, 5);
+    info.sndInfo.snd_sid   = static_cast<uint16_t>(Lua::ToInteger(L, -4));
+    info.sndInfo.snd_ppid  = static_cast<uint32_t>(Lua::ToInteger(L, -3));
+    info.sndInfo.snd_flags = static_cast<uint16_t>(Lua::ToInteger(L, -2));
+    if(not Lua::IsNil(L, -1)) {
+      info.sndInfo.snd_assoc_id = static_cast<sctp_assoc_t>(Lua::ToInteger(L, -1));
+    }
+    //The payload stays referenced by the entry, so the pointer remains valid
+    Lua::Pop(L, 5);
+  } else if(Lua::Type(L, entryIdx) == Lua::Types::String) {
+    payload = Lua::ToLString(L, entryIdx, &length);
+  }
+  if(payload == nullptr) {
+    return false;
+  }
+
+  iovs[slot].iov_base = const_cast<char*>(payload);
+  iovs[slot].iov_len  = length;
+
+  std::memset(&headers[slot], 0, sizeof(mmsghdr));
+  auto& header      = headers[slot].msg_hdr;
+  header.msg_iov    = &iovs[slot];
+  header.msg_iovlen = 1;
+  info.attach(header, controls.get() + slot * ControlSize);
+  return true;
+}
+
+//Pushes the number of messages sent and, if not all of them went through, the reason.
+//sendmmsg(headers, count) does the syscall, so the socket can count it.
+//blocked is set if nothing was sent because of EAGAIN, so the same call can be made again
+template<class SendMmsg>
+auto SendBatch::send(Lua::State* L, int msgsIdx, sctp_assoc_t assocId, bool& blocked, SendMmsg&& sendmmsg) noexcept -> int {
+  const auto msgCount = static_cast<std::size_t>(Lua::RawLen(L, msgsIdx));
+  if(not reserve(msgCount < MaxMessages ? msgCount : MaxMessages)) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "Send batch allocation failed");
+    return 2;
+  }
+
+  std::size_t numSent = 0;
+  while(numSent < msgCount) {
+    std::size_t chunkSize = msgCount - numSent < MaxMessages ? msgCount - numSent : MaxMessages;
+    for(std::size_t i = 0; i < chunkSize; i++) {
+      Lua::RawGet(L, msgsIdx, static_cast<Lua::Integer>(numSent + i + 1));
+      bool loaded = load(L, i, Lua::GetTop(L), assocId);
+      Lua::Pop(L, 1);
+      if(not loaded) {
+        Lua::PushInteger(L, numSent);
+        Lua::PushFString(L, "Invalid message at index %d", static_cast<int>(numSent + i + 1));
+        return 2;
+      }
+    }
+
+    int chunkSent = sendmmsg(headers.get(), static_cast<unsigned>(chunkSize));
+    if(chunkSent >= 0 and static_cast<std::size_t>(chunkSent) < chunkSize) {
+      //sendmmsg() stops at the first failure without reporting it, sending that message alone gets its errno.
+      //If it goes through this time, the rest of the chunk is loaded and sent again
+      numSent  += chunkSent;
+      chunkSent = sendmmsg(headers.get() + chunkSent, 1);
+    }
+    if(chunkSent < 0) {
+      blocked = numSent == 0 and errno == EAGAIN;
+      Lua::PushInteger(L, numSent);
+      Lua::PushFString(L, (errno == EAGAIN ? "EAGAIN" : "sendmmsg: %s"), std::strerror(errno));
+      return 2;
+    }
+    numSent += chunkSent;
+  }
+  Lua::PushInteger(L, numSent);
+  return 1;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPSENDBATCH_HPP */
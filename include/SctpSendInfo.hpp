@@ -0,0 +1,99 @@
+#ifndef SCTPSENDINFO_HPP
+#define SCTPSENDINFO_HPP
+
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netinet/sctp.h>
+
+#include "Lua/Lua.hpp"
+
+namespace Sctp {
+
+//Ancillary data of an outgoing message: SCTP_SNDINFO, followed by SCTP_PRINFO if a PR-SCTP policy was given
+class SendInfo {
+public:
+  static constexpr std::size_t ControlSize = CMSG_SPACE(sizeof(sctp_sndinfo)) + CMSG_SPACE(sizeof(sctp_prinfo));
+public:
+  sctp_sndinfo sndInfo;
+  sctp_prinfo prInfo;
+  bool hasPrInfo;
+public:
+  SendInfo(sctp_assoc_t assocId = 0) noexcept;
+public:
+  auto load(Lua::State*, int optsIdx) noexcept -> void;
+  auto attach(msghdr&, char* control) const noexcept -> void;
+};
+
+inline SendInfo::SendInfo(sctp_assoc_t assocId) noexcept : hasPrInfo(false) {
+  std::memset(&sndInfo, 0, sizeof(sctp_sndinfo));
+  std::memset(&prInfo, 0, sizeof(sctp_prinfo));
+  sndInfo.snd_assoc_id = assocId;
+}
+
+//{ stream = 0, ppid = 0, unordered = false, context = 0, ttl = nil (milliseconds), rtx = nil, prio = nil }
+//ttl, rtx and prio are the PR-SCTP policies, only one of them can be given
+inline auto SendInfo::load(Lua::State* L, int optsIdx) noexcept -> void {
+  int numPolicies = 0;
+  if(Lua::GetField(L, optsIdx, "stream") != Lua::Types::Nil) {
+    sndInfo.snd_sid = static_cast<uint16_t>(Lua::ToInteger(L, -1));
+  }
+  if(Lua::GetField(L, optsIdx, "ppid") != Lua::Types::Nil) {
+    sndInfo.snd_ppid = static_cast<uint32_t>(Lua::ToInteger(L, -1));
+  }
+  if(Lua::GetField(L, optsIdx, "context") != Lua::Types::Nil) {
+    sndInfo.snd_context = static_cast<uint32_t>(Lua::ToInteger(L, -1));
+  }
+  if(Lua::GetField(L, optsIdx, "unordered") != Lua::Types::Nil) {
+    if(Lua::ToBoolean(L, -1)) {
+      sndInfo.snd_flags |= SCTP_UNORDERED;
+    } else {
+      sndInfo.snd_flags &= ~SCTP_UNORDERED;
+    }
+  }
+  if(Lua::GetField(L, optsIdx, "ttl") != Lua::Types::Nil) {
+    prInfo.pr_policy = SCTP_PR_SCTP_TTL;
+    prInfo.pr_value  = static_cast<uint32_t>(Lua::ToInteger(L, -1));
+    hasPrInfo        = true;
+    numPolicies++;
+  }
+  if(Lua::GetField(L, optsIdx, "rtx") != Lua::Types::Nil) {
+    prInfo.pr_policy = SCTP_PR_SCTP_RTX;
+    prInfo.pr_value  = static_cast<uint32_t>(Lua::ToInteger(L, -1));
+    hasPrInfo        = true;
+    numPolicies++;
+  }
+  if(Lua::GetField(L, optsIdx, "prio") != Lua::Types::Nil) {
+    prInfo.pr_policy = SCTP_PR_SCTP_PRIO;
+    prInfo.pr_value  = static_cast<uint32_t>(Lua::ToInteger(L, -1));
+    hasPrInfo        = true;
+    numPolicies++;
+  }
+  Lua::Pop(L, 7);
+  Lua::Aux::ArgCheck(L, numPolicies <= 1, optsIdx, "only one of ttl, rtx and prio can be given");
+}
+
+//control has to be at least ControlSize long and live until the message is sent
+inline auto SendInfo::attach(msghdr& msg, char* control) const noexcept -> void {
+  std::memset(control, 0, ControlSize);
+  msg.msg_control    = control;
+  msg.msg_controllen = hasPrInfo ? ControlSize : CMSG_SPACE(sizeof(sctp_sndinfo));
+
+  auto cmsg        = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = IPPROTO_SCTP;
+  cmsg->cmsg_type  = SCTP_SNDINFO;
+  cmsg->cmsg_len   = CMSG_LEN(sizeof(sctp_sndinfo));
+  std::memcpy(CMSG_DATA(cmsg), &sndInfo, sizeof(sctp_sndinfo));
+
+  if(hasPrInfo) {
+    cmsg             = CMSG_NXTHDR(&msg, cmsg);
+    cmsg->cmsg_level = IPPROTO_SCTP;
+    cmsg->cmsg_type  = SCTP_PRINFO;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(sctp_prinfo));
+    std::memcpy(CMSG_DATA(cmsg), &prInfo, sizeof(sctp_prinfo));
+  }
+}
+
+} //namespace Sctp
+
+#endif /* SCTPSENDINFO_HPP */
@@ -0,0 +1,384 @@
+#ifndef SCTPSEQPACKETSOCKET_HPP
+#define SCTPSEQPACKETSOCKET_HPP
+
+#include <memory>
+#include <new>
+
+#include <sys/uio.h>
+
+#include "SctpSocket.hpp"
+#include "SctpClientSocket.hpp"
+#include "SctpRecvBuffer.hpp"
+#include "SctpRecvBatch.hpp"
+#include "SctpSendBatch.hpp"
+#include "SctpSendInfo.hpp"
+#include "SctpRecvInfo.hpp"
+#include "SctpNotification.hpp"
+#include "SctpBuffer.hpp"
+
+namespace Sctp {
+
+namespace Socket {
+
+//One-to-many style socket: a single descriptor carries every association,
+//so send needs to know the target and recv reports the source association
+template<int IPVersion>
+class SeqPacket final : public Base<IPVersion> {
+public:
+  static constexpr int DefaultBackLogSize = 1000;
+  static const char* MetaTableName;
+private:
+  using SockAddrType = typename Base<IPVersion>::SockAddrType;
+  using AddressArray = typename Base<IPVersion>::AddressArray;
+  //The ancillary data carrying the other addresses of an implicitly set up association
+  static constexpr int DestinationType = IPVersion == 4 ? SCTP_DSTADDRV4 : SCTP_DSTADDRV6;
+  static constexpr std::size_t DestinationSize = IPVersion == 4 ? sizeof(in_addr) : sizeof(in6_addr);
+private:
+  RecvBuffer recvBuffer;
+  RecvBatch recvBatch;
+  SendBatch sendBatch;
+public:
+  SeqPacket(std::size_t recvBufferSize = RecvBuffer::DefaultSize) : Base<IPVersion>(), recvBuffer(recvBufferSize) {}
+public:
+  auto create() noexcept -> bool;
+  auto listen(Lua::State*) noexcept -> int;
+  auto connect(Lua::State*) noexcept -> int;
+  auto sendmsg(Lua::State*) noexcept -> int;
+  auto sendmany(Lua::State*) noexcept -> int;
+  auto recvmsg(Lua::State*) noexcept -> int;
+  auto recvmany(Lua::State*) noexcept -> int;
+  auto recvInto(Lua::State*) noexcept -> int;
+  auto peeloff(Lua::State*) noexcept -> int;
+  auto setRecvBufferSize(Lua::State*) noexcept -> int;
+private:
+  static auto destination(const SockAddrType&) noexcept -> const void*;
+  static auto attachDestinations(msghdr&, const AddressArray&) noexcept -> void;
+};
+
+template<>
+inline auto SeqPacket<4>::destination(const sockaddr_in& addr) noexcept -> const void* {
+  return &addr.sin_addr;
+}
+
+template<>
+inline auto SeqPacket<6>::destination(const sockaddr_in6& addr) noexcept -> const void* {
+  return &addr.sin6_addr;
+}
+
+//Appends an SCTP_DSTADDRV4/V6 for every address after the first (which is msg_name) to the ancillary data in msg,
+//whose control buffer has room for them
+template<int IPVersion>
+auto SeqPacket<IPVersion>::attachDestinations(msghdr& msg, const AddressArray& addrs) noexcept -> void {
+  auto control = static_cast<char*>(msg.msg_control);
+  for(std::size_t i = 1; i < addrs.size(); i++) {
+    auto cmsg = reinterpret_cast<cmsghdr*>(control + msg.msg_controllen);
+    std::memset(cmsg, 0, CMSG_SPACE(DestinationSize));
+    cmsg->cmsg_level = IPPROTO_SCTP;
+    cmsg->cmsg_type  = DestinationType;
+    cmsg->cmsg_len   = CMSG_LEN(DestinationSize);
+    std::memcpy(CMSG_DATA(cmsg), destination(addrs[i]), DestinationSize);
+    msg.msg_controllen += CMSG_SPACE(DestinationSize);
+  }
+}
+
+template<int IPVersion>
+auto SeqPacket<IPVersion>::create() noexcept -> bool {
+  return Base<IPVersion>::create(SOCK_SEQPACKET);
+}
+
+template<int IPVersion>
+auto SeqPacket<IPVersion>::listen(Lua::State* L) noexcept -> int {
+  int backLogSize = Lua::Aux::OptInteger(L, 2, SeqPacket<IPVersion>::DefaultBackLogSize);
+  if(::listen(this->fd, backLogSize) < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "listen: %s", std::strerror(errno));
+    return 2;
+  }
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+template<int IPVersion>
+auto SeqPacket<IPVersion>::connect(Lua::State* L) noexcept -> int {
+  typename Base<IPVersion>::AddressArray parsedAddresses;
+  auto peerAddresses = this->addressSet(L, 2);
+  if(peerAddresses == nullptr) {
+    int loadAddrResult = this->loadAddresses(L, parsedAddresses);
+    if(loadAddrResult > 0) {
+      return loadAddrResult;
+    }
+    peerAddresses = &parsedAddresses;
+  }
+
+  sctp_assoc_t assocId = 0;
+  auto addrs = const_cast<sockaddr*>(reinterpret_cast<const sockaddr*>(peerAddresses->data()));
+  if(this->timed(Stats::Connect, [&] { return ::sctp_connectx(this->fd, addrs, peerAddresses->size(), &assocId); }) < 0) {
+    this->countFailure(Stats::Connect);
+    //On a non-blocking socket the association comes up later, with an assoc_change notification
+    if(errno == EINPROGRESS) {
+      Lua::PushBoolean(L, false);
+      Lua::PushString(L, "EINPROGRESS");
+      Lua::PushInteger(L, assocId);
+      return 3;
+    }
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "sctp_connectx: %s", std::strerror(errno));
+    return 2;
+  }
+
+  Lua::PushBoolean(L, true);
+  Lua::PushInteger(L, assocId);
+  return 2;
+}
+
+//send(payload, assocId [, opts]) or send(payload, port, addr1, ... [, opts]), payload as in Client::sendmsg.
+//An AddressSet can be given in place of port, addr1, ...
+//The latter sets up a new association implicitly with all of the addresses if there isn't one yet.
+//See SendInfo::load() for the options
+template<int IPVersion>
+auto SeqPacket<IPVersion>::sendmsg(Lua::State* L) noexcept -> int {
+  iovec iov;
+  int destIdx = Buffer::loadPayload(L, 2, iov);
+
+  int lastArg = Lua::GetTop(L);
+  SendInfo info;
+  if(Lua::IsTable(L, lastArg)) {
+    info.load(L, lastArg--);
+  }
+
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
+
+  AddressArray parsedAddresses;
+  auto peerAddresses = this->addressSet(L, destIdx);
+  if(peerAddresses == nullptr and lastArg > destIdx) {
+    int loadAddrResult = this->loadAddresses(L, parsedAddresses, destIdx, lastArg);
+    if(loadAddrResult > 0) {
+      return loadAddrResult;
+    }
+    peerAddresses = &parsedAddresses;
+  } else if(peerAddresses == nullptr) {
+    info.sndInfo.snd_assoc_id = static_cast<sctp_assoc_t>(Lua::Aux::CheckInteger(L, destIdx));
+  }
+
+  char control[SendInfo::ControlSize];
+  std::unique_ptr<char[]> controlWithDestinations;
+  if(peerAddresses != nullptr) {
+    msg.msg_name    = const_cast<void*>(static_cast<const void*>(peerAddresses->data()));
+    msg.msg_namelen = sizeof(SockAddrType);
+    if(peerAddresses->size() > 1) {
+      controlWithDestinations.reset(new (std::nothrow) char[SendInfo::ControlSize + (peerAddresses->size() - 1) * CMSG_SPACE(DestinationSize)]);
+      if(controlWithDestinations == nullptr) {
+        Lua::PushBoolean(L, false);
+        Lua::PushString(L, "Control buffer allocation failed");
+        return 2;
+      }
+    }
+  }
+  info.attach(msg, controlWithDestinations == nullptr ? control : controlWithDestinations.get());
+  if(peerAddresses != nullptr) {
+    attachDestinations(msg, *peerAddresses);
+  }
+
+  ssize_t numBytesSent = this->timed(Stats::Send, [&] { return ::sendmsg(this->fd, &msg, 0); });
+  if(numBytesSent < 0) {
+    this->countFailure(Stats::Send);
+    this->blocked = errno == EAGAIN;
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EAGAIN ? "EAGAIN" : "sendmsg: %s"), std::strerror(errno));
+    return 2;
+  }
+  this->countSent(1, numBytesSent);
+  Lua::PushInteger(L, numBytesSent);
+  return 1;
+}
+
+//sendmany(msgs [, assocId]): like Client's sendmany, but entries may have
+//an association id as their 5th field, assocId is used for the rest
+template<int IPVersion>
+auto SeqPacket<IPVersion>::sendmany(Lua::State* L) noexcept -> int {
+  Lua::Aux::CheckType(L, 2, static_cast<int>(Lua::Types::Table));
+  auto assocId = static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 3, 0));
+  return sendBatch.send(L, 2, assocId, this->blocked, [this](mmsghdr* headers, unsigned count) { return this->sendMessages(headers, count); });
+}
+
+//recv([info]): returns the size, the message and its association id.
+//If a table is given, it's filled with the SCTP_RCVINFO fields and returned too.
+//Notifications are returned as tables in place of the message
+template<int IPVersion>
+auto SeqPacket<IPVersion>::recvmsg(Lua::State* L) noexcept -> int {
+  char control[RecvInfo::ControlSize];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t numBytesReceived = this->timed(Stats::Recv, [&] { return recvBuffer.receive(this->fd, msg); });
+  if(numBytesReceived < 0) {
+    this->countFailure(Stats::Recv);
+    this->blocked = errno == EAGAIN or errno == EWOULDBLOCK;
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "recvmsg: %s"), std::strerror(errno));
+    return 2;
+  }
+
+  this->countReceived(1, numBytesReceived);
+  Lua::PushInteger(L, numBytesReceived);
+  Lua::PushInteger(L, Notification::pushMessage(L, recvBuffer.data(), numBytesReceived, msg));
+  this->forgetAddresses(L, recvBuffer.data(), numBytesReceived, msg);
+  recvBuffer.clear();
+  if(Lua::IsTable(L, 2)) {
+    RecvInfo::store(L, msg, 2);
+    Lua::PushValue(L, 2);
+    return 4;
+  }
+  return 3;
+}
+
+//recvmany([max [, msgs [, assocIds]]]): like Client's recvmany,
+//but also returns the association id of each message in a parallel array
+template<int IPVersion>
+auto SeqPacket<IPVersion>::recvmany(Lua::State* L) noexcept -> int {
+  auto maxCount = Lua::Aux::OptInteger(L, 2, RecvBatch::DefaultMessages);
+  Lua::Aux::ArgCheck(L, maxCount > 0 and maxCount <= static_cast<Lua::Integer>(RecvBatch::MaxMessages), 2, "batch size out of range");
+  for(int i = 3; i <= 4; i++) {
+    if(Lua::IsTable(L, i)) {
+      Lua::PushValue(L, i);
+    } else {
+      Lua::CreateTable(L, maxCount, 0);
+    }
+  }
+  const int idsIdx  = Lua::GetTop(L);
+  const int msgsIdx = idsIdx - 1;
+
+  Lua::Integer count = 0;
+  std::uint64_t bytes = 0;
+  auto handler = [this, L, msgsIdx, idsIdx, &count, &bytes](const char* data, std::size_t length, const msghdr& msg) {
+    count++;
+    bytes += length;
+    Lua::PushInteger(L, Notification::pushMessage(L, data, length, msg));
+    this->forgetAddresses(L, data, length, msg);
+    Lua::RawSet(L, idsIdx, count);
+    Lua::RawSet(L, msgsIdx, count);
+  };
+  if(this->timed(Stats::Recv, [&] { return recvBatch.receive(this->fd, recvBuffer, maxCount, handler); }) < 0) {
+    this->countFailure(Stats::Recv);
+    this->blocked = errno == EAGAIN or errno == EWOULDBLOCK;
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "recvmmsg: %s"), std::strerror(errno));
+    return 2;
+  }
+  this->countReceived(count, bytes);
+  TrimArray(L, msgsIdx, count);
+  TrimArray(L, idsIdx, count);
+  Lua::PushInteger(L, count);
+  Lua::Insert(L, msgsIdx);
+  return 3;
+}
+
+//recv_into(buf [, offset [, info]]): like Client's recv_into, but the association id
+//of the message is returned after the completeness flag
+template<int IPVersion>
+auto SeqPacket<IPVersion>::recvInto(Lua::State* L) noexcept -> int {
+  auto buf    = Lua::Aux::CheckUData<Buffer>(L, 2, Buffer::MetaTableName);
+  auto offset = Lua::IsNoneOrNil(L, 3) ? 0 : buf->checkRange(L, 3, 1);
+  if(recvBuffer.pending() > 0 or recvBuffer.interleaved()) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "A partially received message is pending, use recv()");
+    return 2;
+  }
+
+  char control[RecvInfo::ControlSize];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msghdr));
+  msg.msg_control    = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t numBytesReceived = this->timed(Stats::Recv, [&] { return buf->receive(this->fd, offset, msg); });
+  const char* data = buf->data() + offset;
+  if(numBytesReceived >= 0 and (msg.msg_flags & MSG_NOTIFICATION) and not (msg.msg_flags & MSG_EOR)) {
+    //Notifications are decoded whole: the rest goes to recvBuffer, after the part that fit
+    //(if that fails, what arrived is pending for recv())
+    numBytesReceived = recvBuffer.finish(this->fd, data, numBytesReceived, msg);
+    data = recvBuffer.data();
+  }
+  if(numBytesReceived < 0) {
+    this->countFailure(Stats::Recv);
+    this->blocked = errno == EAGAIN or errno == EWOULDBLOCK;
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "recvmsg: %s"), std::strerror(errno));
+    return 2;
+  }
+
+  Lua::PushInteger(L, numBytesReceived);
+  const bool complete = msg.msg_flags & MSG_EOR;
+  this->countReceived(complete ? 1 : 0, numBytesReceived);
+  if(not complete) {
+    this->count(Stats::Truncated);
+  }
+  if(complete and (msg.msg_flags & MSG_NOTIFICATION)) {
+    Lua::PushInteger(L, Notification::push(L, data, numBytesReceived));
+    this->forgetAddresses(L, data, numBytesReceived, msg);
+    recvBuffer.clear();
+  } else {
+    auto info = RecvInfo::find(msg);
+    Lua::PushBoolean(L, complete);
+    Lua::PushInteger(L, info == nullptr ? 0 : info->rcv_assoc_id);
+  }
+  if(Lua::IsTable(L, 4)) {
+    RecvInfo::store(L, msg, 4);
+    Lua::PushValue(L, 4);
+    return 4;
+  }
+  return 3;
+}
+
+//peeloff(assocId [, opts]): branches the association off to its own one-to-one socket (a client socket).
+//It's non-blocking and close-on-exec unless opts says otherwise ({ nonblocking = false, cloexec = false })
+template<int IPVersion>
+auto SeqPacket<IPVersion>::peeloff(Lua::State* L) noexcept -> int {
+  auto assocId = static_cast<sctp_assoc_t>(Lua::Aux::CheckInteger(L, 2));
+  unsigned flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  if(Lua::IsTable(L, 3)) {
+    if(Lua::GetField(L, 3, "nonblocking") != Lua::Types::Nil and not Lua::ToBoolean(L, -1)) {
+      flags &= ~SOCK_NONBLOCK;
+    }
+    if(Lua::GetField(L, 3, "cloexec") != Lua::Types::Nil and not Lua::ToBoolean(L, -1)) {
+      flags &= ~SOCK_CLOEXEC;
+    }
+    Lua::Pop(L, 2);
+  }
+
+  int newFD = ::sctp_peeloff_flags(this->fd, assocId, flags);
+  if(newFD < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "sctp_peeloff_flags: %s", std::strerror(errno));
+    return 2;
+  }
+  if(not Client<IPVersion>::push(L, newFD, flags & SOCK_NONBLOCK)) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "Socket userdata allocation failed");
+    return 2;
+  }
+  return 1;
+}
+
+template<int IPVersion>
+auto SeqPacket<IPVersion>::setRecvBufferSize(Lua::State* L) noexcept -> int {
+  auto size = Lua::Aux::CheckInteger(L, 2);
+  if(size <= 0 or not recvBuffer.resize(size)) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "Can't resize receive buffer to %d bytes", static_cast<int>(size));
+    return 2;
+  }
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+} //namespace Socket
+
+} //namespace Sctp
+
+#endif /* SCTPSEQPACKETSOCKET_HPP */
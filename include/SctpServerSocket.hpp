@@ -1,8 +1,12 @@
 #ifndef SCTPSERVERSOCKET_HPP
 #define SCTPSERVERSOCKET_HPP
 
+#include <poll.h>
+#include <sys/epoll.h>
+
 #include "SctpSocket.hpp"
 #include "SctpClientSocket.hpp"
+#include "SctpScheduler.hpp"
 
 namespace Sctp {
 
@@ -13,13 +17,29 @@ class Server final : public Base<IPVersion> {
 public:
   static constexpr int DefaultBackLogSize = 1000;
   static const char* MetaTableName;
+private:
+  //A serve_workers worker's epoll descriptor, watching its listening descriptor and the workers' stop eventfd
+  int waitFD;
 public:
-  Server() : Base<IPVersion>() {}
+  Server() : Base<IPVersion>(), waitFD(-1) {}
+  Server(int sock, int waitFD = -1) : Base<IPVersion>(sock), waitFD(waitFD) {}
+  ~Server();
 public:
   auto listen(Lua::State*) noexcept -> int;
   auto accept(Lua::State*) noexcept -> int;
+  auto acceptmany(Lua::State*) noexcept -> int;
+private:
+  auto stopped() noexcept -> bool;
+  auto acceptNext(int flags, bool& stop) noexcept -> int;
 };
 
+template<int IPVersion>
+Server<IPVersion>::~Server() {
+  if(waitFD > -1) {
+    ::close(waitFD);
+  }
+}
+
 template<int IPVersion>
 auto Server<IPVersion>::listen(Lua::State* L) noexcept -> int {
   int backLogSize = Lua::Aux::OptInteger(L, 2, Server<IPVersion>::DefaultBackLogSize);
@@ -33,33 +53,140 @@ auto Server<IPVersion>::listen(Lua::State* L) noexcept -> int {
   return 1;
 }
 
+//Whether a worker was told to stop. A blocking one waits for that as well as for the next association,
+//so a worker waiting to accept can be stopped.
+//The listening descriptor is registered with EPOLLEXCLUSIVE, so an association wakes one of the waiting workers
+//while the stop eventfd wakes all of them
+template<int IPVersion>
+auto Server<IPVersion>::stopped() noexcept -> bool {
+  epoll_event events[2];
+  int numEvents;
+  while((numEvents = ::epoll_wait(waitFD, events, 2, this->nonBlocking ? 0 : -1)) < 0 and errno == EINTR) {}
+  for(int i = 0; i < numEvents; i++) {
+    if(events[i].data.fd != this->fd) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//accept4() that only ever blocks in stopped() for a worker: the workers' listening descriptors share one
+//non-blocking file description, so the association another worker took makes it retry instead of blocking in accept4().
+//Returns -1 with stop set once the workers have to stop
+template<int IPVersion>
+auto Server<IPVersion>::acceptNext(int flags, bool& stop) noexcept -> int {
+  stop = false;
+  while(true) {
+    if(waitFD > -1 and this->fd > -1 and (stop = stopped())) {
+      return -1;
+    }
+    int newFD = this->timed(Stats::Accept, [&] { return ::accept4(this->fd, nullptr, nullptr, flags); });
+    if(newFD > -1 or waitFD < 0 or this->nonBlocking or (errno != EAGAIN and errno != EWOULDBLOCK)) {
+      return newFD;
+    }
+  }
+}
+
 template<int IPVersion>
 auto Server<IPVersion>::accept(Lua::State* L) noexcept -> int {
-  int newFD = ::accept(this->fd, nullptr, nullptr);
+  //Inside a task the new socket has to be non-blocking too, so it can yield
+  const bool inTask = this->nonBlocking and Scheduler::isTask(L);
+  bool stop;
+  int newFD = acceptNext(inTask ? SOCK_NONBLOCK : 0, stop);
+  if(stop) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "stopped");
+    return 2;
+  }
   if(newFD < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
     //Non-blocking socket is being used, nothing to do
+    this->countFailure(Stats::Accept);
+    this->blocked = true;
     Lua::PushBoolean(L, false);
     Lua::PushString(L, "EAGAIN/EWOULDBLOCK");
     return 2;
   } else if(newFD < 0) {
+    this->countFailure(Stats::Accept);
     Lua::PushBoolean(L, false);
     Lua::PushFString(L, "accept() failed: %s", std::strerror(errno));
     return 2;
   }
-  auto connSock = Lua::NewUserData<Sctp::Socket::Client<IPVersion>>(L);
-  if(connSock == nullptr) {
+  this->count(Stats::Accepted);
+  if(not Client<IPVersion>::push(L, newFD, inTask)) {
     Lua::PushNil(L);
     Lua::PushString(L, "Socket userdata allocation failed");
     return 2;
   }
+  return 1;
+}
 
-  new (connSock) Sctp::Socket::Client<IPVersion>(newFD);
+//acceptmany([max [, opts]]): accepts until the backlog is drained or max (default: 64) is reached.
+//opts: { nonblocking = true, cloexec = true } for the new sockets.
+//Returns the number of new sockets and an array of them.
+//An error after the first socket (other than EAGAIN) is returned as a 3rd value along with the sockets accepted so far
+template<int IPVersion>
+auto Server<IPVersion>::acceptmany(Lua::State* L) noexcept -> int {
+  auto maxCount = Lua::Aux::OptInteger(L, 2, 64);
+  Lua::Aux::ArgCheck(L, maxCount > 0, 2, "must be positive");
 
-  Lua::Aux::GetMetaTable(L, Sctp::Socket::Client<IPVersion>::MetaTableName);
-  Lua::SetMetaTable(L, -2);
-  return 1;
+  int flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  if(Lua::IsTable(L, 3)) {
+    if(Lua::GetField(L, 3, "nonblocking") != Lua::Types::Nil and not Lua::ToBoolean(L, -1)) {
+      flags &= ~SOCK_NONBLOCK;
+    }
+    if(Lua::GetField(L, 3, "cloexec") != Lua::Types::Nil and not Lua::ToBoolean(L, -1)) {
+      flags &= ~SOCK_CLOEXEC;
+    }
+    Lua::Pop(L, 2);
+  }
+
+  Lua::CreateTable(L, maxCount < 64 ? maxCount : 64, 0);
+  Lua::Integer count = 0;
+  while(count < maxCount) {
+    //A blocking listener would wait for the next association, only the first accept may do that
+    if(count > 0 and not this->nonBlocking) {
+      pollfd pfd = { this->fd, POLLIN, 0 };
+      if(::poll(&pfd, 1, 0) < 1) {
+        break;
+      }
+    }
+    bool stop = false;
+    int newFD = count == 0 ? acceptNext(flags, stop) : this->timed(Stats::Accept, [&] { return ::accept4(this->fd, nullptr, nullptr, flags); });
+    if(stop) {
+      Lua::PushBoolean(L, false);
+      Lua::PushString(L, "stopped");
+      return 2;
+    }
+    if(newFD < 0) {
+      this->countFailure(Stats::Accept);
+      if(count > 0) {
+        if(errno == EAGAIN or errno == EWOULDBLOCK) {
+          break;
+        }
+        Lua::PushInteger(L, count);
+        Lua::Insert(L, -2);
+        Lua::PushFString(L, "accept4: %s", std::strerror(errno));
+        return 3;
+      }
+      this->blocked = errno == EAGAIN or errno == EWOULDBLOCK;
+      Lua::PushBoolean(L, false);
+      Lua::PushFString(L, (errno == EAGAIN or errno == EWOULDBLOCK ? "EAGAIN/EWOULDBLOCK" : "accept4: %s"), std::strerror(errno));
+      return 2;
+    }
+    this->count(Stats::Accepted);
+    if(not Client<IPVersion>::push(L, newFD, flags & SOCK_NONBLOCK)) {
+      Lua::PushNil(L);
+      Lua::PushString(L, "Socket userdata allocation failed");
+      return 2;
+    }
+    Lua::RawSet(L, -2, ++count);
+  }
+  Lua::PushInteger(L, count);
+  Lua::Insert(L, -2);
+  return 2;
 }
 
+
 } //namespace Socket
 
 } //namespace Sctp
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <cerrno>
 #include <type_traits>
+#include <initializer_list>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -14,13 +15,25 @@
 #include <fcntl.h>
 
 #include "Lua/Lua.hpp"
+#include "SctpOptions.hpp"
+#include "SctpAddressSet.hpp"
+#include "SctpStats.hpp"
 
 namespace Sctp {
 
+inline auto PushAddress(Lua::State*, const sockaddr*) noexcept -> bool;
+
+//Slot of a socket's user value with the objects (pollers) that have to know when it's closed
+constexpr Lua::Integer WatchersSlot = 3;
+
+//Tells the watchers of the socket at sockIdx that it's about to close fd.
+//Defined next to the metatables, since it has to know all of them
+auto SocketClosing(Lua::State* L, int sockIdx, int fd) noexcept -> void;
+
 namespace Socket {
 
 template<int IPVersion>
-class Base {
+class Base : protected Counting<> {
   static_assert(IPVersion == 4 or IPVersion == 6, "");
 public:
   using SockAddrType = std::conditional_t<IPVersion == 4, sockaddr_in, sockaddr_in6>;
@@ -28,6 +41,8 @@ public:
   static constexpr int IPv = IPVersion;
 protected:
   int fd;
+  bool nonBlocking;
+  bool blocked;
   bool haveBoundAddresses;
   AddressArray boundAddresses;
 public:
@@ -35,12 +50,31 @@ public:
   Base(int sock) noexcept;
   ~Base();
 public:
-  auto create() noexcept -> bool;
+  auto create(int style = SOCK_STREAM) noexcept -> bool;
+  auto fileDescriptor() const noexcept -> int { return fd; }
+  //Whether the last call failed only because it would have blocked, see Scheduler
+  auto wouldBlock() const noexcept -> bool { return blocked; }
+  auto resetWouldBlock() noexcept -> void { blocked = false; }
   auto bind(Lua::State*) noexcept -> int;
   auto close(Lua::State*) noexcept -> int;
   auto setNonBlocking(Lua::State*) noexcept -> int;
+  auto subscribe(Lua::State*) noexcept -> int;
+  auto setopt(Lua::State* L) noexcept -> int { return Options::set(L, fd); }
+  auto getopt(Lua::State* L) noexcept -> int { return Options::get(L, fd); }
+  auto setPriority(Lua::State* L) noexcept -> int { return Options::setPriority(L, fd); }
+  auto getPriority(Lua::State* L) noexcept -> int { return Options::getPriority(L, fd); }
+  auto abandoned(Lua::State* L) noexcept -> int { return Options::abandoned(L, fd); }
+  auto stats(Lua::State* L) noexcept -> int { return this->pushStats(L); }
+  auto getPeerAddresses(Lua::State*) noexcept -> int;
+  auto getLocalAddresses(Lua::State*) noexcept -> int;
 protected:
-  auto loadAddresses(Lua::State*, AddressArray&) noexcept -> int;
+  //Slots of the address caches in the user value, WatchersSlot comes after them
+  enum AddressCaches { PeerAddresses = 1, LocalAddresses = 2 };
+  auto getAddresses(Lua::State*, AddressCaches) noexcept -> int;
+  auto forgetAddresses(Lua::State*, const char* data, std::size_t length, const msghdr&) noexcept -> void;
+  auto loadAddresses(Lua::State*, AddressArray&, int portIdx = 2, int lastIdx = 0) noexcept -> int;
+  auto addressSet(Lua::State*, int idx) noexcept -> const AddressArray*;
+  auto sendMessages(mmsghdr* headers, unsigned count) noexcept -> int;
 private:
   auto bindFirst(Lua::State*) noexcept -> int;
   auto pushIPAddress(Lua::State*, AddressArray&, const char* ip, uint16_t port, int idx) noexcept -> int;
@@ -48,21 +82,23 @@ private:
 };
 
 template<int IPVersion>
-Base<IPVersion>::Base() noexcept : haveBoundAddresses(false) {}
+Base<IPVersion>::Base() noexcept : nonBlocking(false), blocked(false), haveBoundAddresses(false) {}
 
 template<int IPVersion>
-auto Base<IPVersion>::create() noexcept -> bool {
-  fd = ::socket(IPVersion == 4 ? AF_INET : AF_INET6, SOCK_STREAM, IPPROTO_SCTP);
+auto Base<IPVersion>::create(int style) noexcept -> bool {
+  fd = ::socket(IPVersion == 4 ? AF_INET : AF_INET6, style, IPPROTO_SCTP);
   if(fd == -1) {
     return false;
   }
   int True = 1;
-  setsockopt(fd, IPPROTO_SCTP, SO_REUSEADDR, &True, sizeof(int));
-  return true;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &True, sizeof(int));
+  //Needed for recv to report stream, ppid, association, etc.
+  //Sockets returned by accept() inherit it from the listening one
+  return ::setsockopt(fd, IPPROTO_SCTP, SCTP_RECVRCVINFO, &True, sizeof(int)) == 0;
 }
 
 template<int IPVersion>
-Base<IPVersion>::Base(int sock) noexcept : fd(sock), haveBoundAddresses(false) {}
+Base<IPVersion>::Base(int sock) noexcept : fd(sock), nonBlocking(false), blocked(false), haveBoundAddresses(false) {}
 
 template<int IPVersion>
 Base<IPVersion>::~Base() {
@@ -83,17 +119,65 @@ template<int IPVersion>
     Lua::PushFString(L, "fcntl(set): %s", std::strerror(errno));
     return 2;
   }
+  nonBlocking = true;
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//subscribe({ assoc_change = true, sender_dry = true, ... } [, assocId])
+//Without assocId every current and future association is affected
+template<int IPVersion>
+auto Base<IPVersion>::subscribe(Lua::State* L) noexcept -> int {
+  static const struct {
+    const char* name;
+    uint16_t type;
+  } Events[] = {
+    { "assoc_change",     SCTP_ASSOC_CHANGE },
+    { "peer_addr_change", SCTP_PEER_ADDR_CHANGE },
+    { "remote_error",     SCTP_REMOTE_ERROR },
+    { "send_failed",      SCTP_SEND_FAILED_EVENT },
+    { "shutdown",         SCTP_SHUTDOWN_EVENT },
+    { "partial_delivery", SCTP_PARTIAL_DELIVERY_EVENT },
+    { "adaptation",       SCTP_ADAPTATION_INDICATION },
+    { "authentication",   SCTP_AUTHENTICATION_EVENT },
+    { "sender_dry",       SCTP_SENDER_DRY_EVENT },
+    { "stream_reset",     SCTP_STREAM_RESET_EVENT },
+    { "assoc_reset",      SCTP_ASSOC_RESET_EVENT },
+    { "stream_change",    SCTP_STREAM_CHANGE_EVENT },
+  };
+  Lua::Aux::CheckType(L, 2, static_cast<int>(Lua::Types::Table));
+
+  sctp_event event;
+  std::memset(&event, 0, sizeof(sctp_event));
+  event.se_assoc_id = static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 3, SCTP_ALL_ASSOC));
+  for(const auto& ev : Events) {
+    if(Lua::GetField(L, 2, ev.name) != Lua::Types::Nil) {
+      event.se_type = ev.type;
+      event.se_on   = Lua::ToBoolean(L, -1) ? 1 : 0;
+      if(::setsockopt(fd, IPPROTO_SCTP, SCTP_EVENT, &event, sizeof(sctp_event)) < 0) {
+        Lua::PushBoolean(L, false);
+        Lua::PushFString(L, "setsockopt(SCTP_EVENT, %s): %s", ev.name, std::strerror(errno));
+        return 2;
+      }
+    }
+    Lua::Pop(L, 1);
+  }
   Lua::PushBoolean(L, true);
   return 1;
 }
 
 template<int IPVersion>
 auto Base<IPVersion>::bind(Lua::State* L) noexcept -> int {
-  int loadAddrResult = loadAddresses(L, boundAddresses);
-  std::size_t addrCount = boundAddresses.size();
-  if(loadAddrResult > 0) {
-    return loadAddrResult;
+  auto set = addressSet(L, 2);
+  if(set != nullptr) {
+    boundAddresses = *set;
+  } else {
+    int loadAddrResult = loadAddresses(L, boundAddresses);
+    if(loadAddrResult > 0) {
+      return loadAddrResult;
+    }
   }
+  std::size_t addrCount = boundAddresses.size();
 
   int retVal = bindFirst(L);
   if(retVal > 0) {
@@ -114,10 +198,10 @@ auto Base<IPVersion>::bind(Lua::State* L) noexcept -> int {
 }
 
 template<int IPVersion>
-auto Base<IPVersion>::loadAddresses(Lua::State* L, AddressArray& addrs) noexcept -> int {
-  uint16_t port = htons(Lua::ToInteger(L, 2));
-  int stackSize = Lua::GetTop(L);
-  std::size_t addrCount = stackSize - 2;
+auto Base<IPVersion>::loadAddresses(Lua::State* L, AddressArray& addrs, int portIdx, int lastIdx) noexcept -> int {
+  uint16_t port = htons(Lua::ToInteger(L, portIdx));
+  int stackSize = lastIdx > 0 ? lastIdx : Lua::GetTop(L);
+  int addrCount = stackSize - portIdx;
   if(addrCount < 1) {
     Lua::PushBoolean(L, false);
     Lua::PushString(L, "No addresses were given");
@@ -126,8 +210,8 @@ auto Base<IPVersion>::loadAddresses(Lua::State* L, AddressArray& addrs) noexcept
   addrs.clear();
   addrs.resize(addrCount);
   std::memset(addrs.data(), 0, sizeof(SockAddrType) * addrCount);
-  for(int i = 3; i <= stackSize; i++) {
-    int idx = i - 3;
+  for(int i = portIdx + 1; i <= stackSize; i++) {
+    int idx = i - portIdx - 1;
     auto addrI = Lua::ToString(L, i);
     int pushResult = pushIPAddress(L, addrs, addrI, port, idx);
     if(pushResult > 0) {
@@ -137,6 +221,35 @@ auto Base<IPVersion>::loadAddresses(Lua::State* L, AddressArray& addrs) noexcept
   return 0;
 }
 
+//The addresses of the AddressSet at idx, nullptr if it's something else
+template<int IPVersion>
+auto Base<IPVersion>::addressSet(Lua::State* L, int idx) noexcept -> const AddressArray* {
+  auto set = Lua::Aux::TestUData<AddressSet>(L, idx, AddressSet::MetaTableName);
+  if(set == nullptr) {
+    return nullptr;
+  }
+  if(set->addresses<IPVersion>().empty()) {
+    Lua::Aux::ArgError(L, idx, "addresses of the other IP version");
+  }
+  return &set->addresses<IPVersion>();
+}
+
+//sendmmsg() for the SendBatch, counted
+template<int IPVersion>
+auto Base<IPVersion>::sendMessages(mmsghdr* headers, unsigned count) noexcept -> int {
+  int numSent = this->timed(Stats::Send, [&] { return ::sendmmsg(fd, headers, count, 0); });
+  if(numSent < 0) {
+    this->countFailure(Stats::Send);
+    return numSent;
+  }
+  std::uint64_t bytes = 0;
+  for(int i = 0; i < numSent; i++) {
+    bytes += headers[i].msg_len;
+  }
+  this->countSent(numSent, bytes);
+  return numSent;
+}
+
 template<int IPVersion>
 auto Base<IPVersion>::bindFirst(Lua::State* L) noexcept -> int {
   int bindRes = ::bind(fd, reinterpret_cast<sockaddr*>(boundAddresses.data()), sizeof(SockAddrType));
@@ -181,6 +294,9 @@ auto Base<IPVersion>::checkIPConversionResult(Lua::State* L, const char* ip, int
 
 template<int IPVersion>
 auto Base<IPVersion>::close(Lua::State* L) noexcept -> int {
+  if(fd > -1) {
+    SocketClosing(L, 1, fd);
+  }
   if(fd > -1 and ::close(fd) < 0) {
     Lua::PushBoolean(L, false);
     Lua::PushFString(L, "close: %s", std::strerror(errno));
@@ -193,8 +309,166 @@ auto Base<IPVersion>::close(Lua::State* L) noexcept -> int {
   return 1;
 }
 
+//getpaddrs([assocId])
+template<int IPVersion>
+auto Base<IPVersion>::getPeerAddresses(Lua::State* L) noexcept -> int {
+  return getAddresses(L, PeerAddresses);
+}
+
+//getladdrs([assocId])
+template<int IPVersion>
+auto Base<IPVersion>::getLocalAddresses(Lua::State* L) noexcept -> int {
+  return getAddresses(L, LocalAddresses);
+}
+
+//Returns { "addr1", "addr2", ..., port = port } of the association.
+//The lists are cached in the user value by association id until forgetAddresses() drops them
+template<int IPVersion>
+auto Base<IPVersion>::getAddresses(Lua::State* L, AddressCaches cache) noexcept -> int {
+  auto assocId = static_cast<sctp_assoc_t>(Lua::Aux::OptInteger(L, 2, 0));
+  if(Lua::GetUserValue(L, 1) != Lua::Types::Table) {
+    Lua::Pop(L, 1);
+    Lua::Newtable(L);
+    Lua::PushValue(L, -1);
+    Lua::SetUserValue(L, 1);
+  }
+  if(Lua::RawGet(L, -1, cache) != Lua::Types::Table) {
+    Lua::Pop(L, 1);
+    Lua::Newtable(L);
+    Lua::PushValue(L, -1);
+    Lua::RawSet(L, -3, cache);
+  }
+  if(Lua::RawGet(L, -1, assocId) == Lua::Types::Table) {
+    return 1;
+  }
+  Lua::Pop(L, 1);
+
+  sockaddr* addrs = nullptr;
+  int count = cache == PeerAddresses ? ::sctp_getpaddrs(fd, assocId, &addrs) : ::sctp_getladdrs(fd, assocId, &addrs);
+  if(count < 0) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, (cache == PeerAddresses ? "sctp_getpaddrs: %s" : "sctp_getladdrs: %s"), std::strerror(errno));
+    return 2;
+  }
+  Lua::CreateTable(L, count, 1);
+  auto addr = reinterpret_cast<const char*>(addrs);
+  for(int i = 0; i < count; i++) {
+    auto sa = reinterpret_cast<const sockaddr*>(addr);
+    if(i == 0) {
+      Lua::PushInteger(L, ntohs(reinterpret_cast<const sockaddr_in*>(sa)->sin_port));
+      Lua::SetField(L, -2, "port");
+    }
+    if(PushAddress(L, sa)) {
+      Lua::RawSet(L, -2, static_cast<Lua::Integer>(Lua::RawLen(L, -2) + 1));
+    }
+    addr += sa->sa_family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+  }
+  //An empty list is allocated too. The pointer sctp_free*addrs() gets is offset into the allocation, so null isn't safe
+  if(addrs != nullptr) {
+    if(cache == PeerAddresses) {
+      ::sctp_freepaddrs(addrs);
+    } else {
+      ::sctp_freeladdrs(addrs);
+    }
+  }
+  if(count == 0) {
+    //Not cached, it's likely to be asked for before the association is up
+    return 1;
+  }
+  Lua::PushValue(L, -1);
+  Lua::RawSet(L, -3, assocId);
+  return 1;
+}
+
+//Drops the cached address lists of the association an address or association change notification is about,
+//and the ones asked for without an association id
+template<int IPVersion>
+auto Base<IPVersion>::forgetAddresses(Lua::State* L, const char* data, std::size_t length, const msghdr& msg) noexcept -> void {
+  if(not (msg.msg_flags & MSG_NOTIFICATION)) {
+    return;
+  }
+  auto sn = reinterpret_cast<const sctp_notification*>(data);
+  sctp_assoc_t assocId;
+  if(length >= sizeof(sctp_paddr_change) and sn->sn_header.sn_type == SCTP_PEER_ADDR_CHANGE) {
+    assocId = sn->sn_paddr_change.spc_assoc_id;
+  } else if(length >= sizeof(sctp_assoc_change) and sn->sn_header.sn_type == SCTP_ASSOC_CHANGE) {
+    assocId = sn->sn_assoc_change.sac_assoc_id;
+  } else {
+    return;
+  }
+  if(Lua::GetUserValue(L, 1) == Lua::Types::Table) {
+    for(auto cache : { PeerAddresses, LocalAddresses }) {
+      if(Lua::RawGet(L, -1, cache) == Lua::Types::Table) {
+        Lua::PushNil(L);
+        Lua::RawSet(L, -2, assocId);
+        Lua::PushNil(L);
+        Lua::RawSet(L, -2, static_cast<Lua::Integer>(0));
+      }
+      Lua::Pop(L, 1);
+    }
+  }
+  Lua::Pop(L, 1);
+}
+
 } //namespace Socket
 
+//Descriptor of the socket userdata (of any kind) at idx, -1 if it's something else.
+//Defined next to the metatables, since it has to know all of them
+auto ToFileDescriptor(Lua::State* L, int idx) noexcept -> int;
+
+//Pushes the textual IP address, returns false (and pushes nothing) for non-IP families
+inline auto PushAddress(Lua::State* L, const sockaddr* addr) noexcept -> bool {
+  char str[INET6_ADDRSTRLEN];
+  const void* src = nullptr;
+  if(addr->sa_family == AF_INET) {
+    src = &reinterpret_cast<const sockaddr_in*>(addr)->sin_addr;
+  } else if(addr->sa_family == AF_INET6) {
+    src = &reinterpret_cast<const sockaddr_in6*>(addr)->sin6_addr;
+  }
+  if(src == nullptr or ::inet_ntop(addr->sa_family, src, str, sizeof(str)) == nullptr) {
+    return false;
+  }
+  Lua::PushString(L, str);
+  return true;
+}
+
+//Adds the object at watcherIdx to the ones SocketClosing() tells about the socket at sockIdx.
+//They're weak keys, a socket doesn't keep its watchers alive
+inline auto Watch(Lua::State* L, int sockIdx, int watcherIdx) noexcept -> void {
+  sockIdx    = Lua::AbsIndex(L, sockIdx);
+  watcherIdx = Lua::AbsIndex(L, watcherIdx);
+  if(Lua::GetUserValue(L, sockIdx) != Lua::Types::Table) {
+    Lua::Pop(L, 1);
+    Lua::Newtable(L);
+    Lua::PushValue(L, -1);
+    Lua::SetUserValue(L, sockIdx);
+  }
+  if(Lua::RawGet(L, -1, WatchersSlot) != Lua::Types::Table) {
+    Lua::Pop(L, 1);
+    Lua::Newtable(L);
+    Lua::CreateTable(L, 0, 1);
+    Lua::PushString(L, "k");
+    Lua::SetField(L, -2, "__mode");
+    Lua::SetMetaTable(L, -2);
+    Lua::PushValue(L, -1);
+    Lua::RawSet(L, -3, WatchersSlot);
+  }
+  Lua::PushValue(L, watcherIdx);
+  Lua::PushBoolean(L, true);
+  Lua::RawSet(L, -3);
+  Lua::Pop(L, 2);
+}
+
+//Cuts an array that is being reused as an output parameter to the given length
+inline auto TrimArray(Lua::State* L, int idx, Lua::Integer length) noexcept -> void {
+  for(Lua::Integer i = length + 1; Lua::RawGet(L, idx, i) != Lua::Types::Nil; i++) {
+    Lua::Pop(L, 1);
+    Lua::PushNil(L);
+    Lua::RawSet(L, idx, i);
+  }
+  Lua::Pop(L, 1);
+}
+
 template<class Type>
 struct IsSctpSocket : public std::integral_constant<bool,
                                                     std::is_same<Type, Socket::Base<4>>::value or
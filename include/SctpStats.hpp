@@ -0,0 +1,218 @@
+#ifndef SCTPSTATS_HPP
+#define SCTPSTATS_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cerrno>
+
+#include "Lua/Lua.hpp"
+
+//Set by the stats build option: 0 compiles the counters out, 1 keeps them, 2 adds the latency histograms
+#ifndef SCTP_STATS
+#define SCTP_STATS 1
+#endif
+
+namespace Sctp {
+
+//Hot path counters of a socket, or the module-wide totals of a thread.
+//Each thread counts into its own totals, so counting never takes a lock or shares a cache line with another thread
+class Stats {
+public:
+  enum Counts { MessagesSent, BytesSent, MessagesReceived, BytesReceived, WouldBlock, Truncated, Accepted, CountsSize };
+  enum Calls { Send, Recv, Accept, Connect, CallsSize };
+  static constexpr bool Enabled    = SCTP_STATS > 0;
+  static constexpr bool Histograms = SCTP_STATS > 1;
+  //Bucket i counts the calls that took less than 2^i ns (and at least 2^(i-1)), the last one everything longer
+  static constexpr int Buckets = 32;
+private:
+  //Written only by the thread it belongs to, read by any
+  class Counter {
+    std::atomic<std::uint64_t> value{0};
+  public:
+    auto add(std::uint64_t n) noexcept -> void { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    auto get() const noexcept -> std::uint64_t { return value.load(std::memory_order_relaxed); }
+  };
+  Counter counts[CountsSize];
+  Counter errors[CallsSize];
+  Counter latency[CallsSize][Histograms ? Buckets : 1];
+public:
+  auto add(Counts which, std::uint64_t n) noexcept -> void { counts[which].add(n); }
+  auto fail(Calls call) noexcept -> void { errors[call].add(1); }
+  auto took(Calls call, std::chrono::nanoseconds duration) noexcept -> void;
+  auto merge(const Stats&) noexcept -> void;
+  auto push(Lua::State*) const noexcept -> void;
+  static auto local() noexcept -> Stats&;
+  static auto total(Stats&) noexcept -> void;
+private:
+  struct Registry;
+  static auto registry() noexcept -> Registry&;
+};
+
+struct Stats::Registry {
+  std::mutex mutex;
+  std::vector<const Stats*> threads;
+  //Totals of the threads that are gone
+  Stats finished;
+};
+
+inline auto Stats::took(Calls call, std::chrono::nanoseconds duration) noexcept -> void {
+  auto ns = static_cast<std::uint64_t>(duration.count());
+  int bucket = 0;
+  while(ns > 0 and bucket < Buckets - 1) {
+    ns >>= 1;
+    bucket++;
+  }
+  latency[call][Histograms ? bucket : 0].add(1);
+}
+
+inline auto Stats::merge(const Stats& other) noexcept -> void {
+  for(int i = 0; i < CountsSize; i++) {
+    counts[i].add(other.counts[i].get());
+  }
+  for(int call = 0; call < CallsSize; call++) {
+    errors[call].add(other.errors[call].get());
+    for(int bucket = 0; bucket < (Histograms ? Buckets : 1); bucket++) {
+      latency[call][bucket].add(other.latency[call][bucket].get());
+    }
+  }
+}
+
+//{ messages_sent, bytes_sent, ..., errors = { send, recv, accept, connect }, latency = { send = { buckets }, ... } }
+inline auto Stats::push(Lua::State* L) const noexcept -> void {
+  static const char* CountNames[] = { "messages_sent", "bytes_sent", "messages_received", "bytes_received", "would_block", "truncated", "accepted" };
+  static const char* CallNames[]  = { "send", "recv", "accept", "connect" };
+  Lua::CreateTable(L, 0, CountsSize + 2);
+  for(int i = 0; i < CountsSize; i++) {
+    Lua::PushInteger(L, static_cast<Lua::Integer>(counts[i].get()));
+    Lua::SetField(L, -2, CountNames[i]);
+  }
+  Lua::CreateTable(L, 0, CallsSize);
+  for(int call = 0; call < CallsSize; call++) {
+    Lua::PushInteger(L, static_cast<Lua::Integer>(errors[call].get()));
+    Lua::SetField(L, -2, CallNames[call]);
+  }
+  Lua::SetField(L, -2, "errors");
+  if(Histograms) {
+    Lua::CreateTable(L, 0, CallsSize);
+    for(int call = 0; call < CallsSize; call++) {
+      Lua::CreateTable(L, Buckets, 0);
+      for(int bucket = 0; bucket < Buckets; bucket++) {
+        Lua::PushInteger(L, static_cast<Lua::Integer>(latency[call][bucket].get()));
+        Lua::RawSet(L, -2, static_cast<Lua::Integer>(bucket + 1));
+      }
+      Lua::SetField(L, -2, CallNames[call]);
+    }
+    Lua::SetField(L, -2, "latency");
+  }
+}
+
+inline auto Stats::registry() noexcept -> Registry& {
+  static Registry instance;
+  return instance;
+}
+
+//The totals of the calling thread, registered on first use and folded into the finished ones when the thread exits
+inline auto Stats::local() noexcept -> Stats& {
+  struct Registration {
+    Stats stats;
+    Registration() {
+      auto& reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.threads.push_back(&stats);
+    }
+    ~Registration() {
+      auto& reg = registry();
+      std::lock_guard<std::mutex> lock(reg.mutex);
+      reg.finished.merge(stats);
+      reg.threads.erase(std::find(reg.threads.begin(), reg.threads.end(), &stats));
+    }
+  };
+  static thread_local Registration registration;
+  return registration.stats;
+}
+
+//Adds the totals of every thread to sum
+inline auto Stats::total(Stats& sum) noexcept -> void {
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  sum.merge(reg.finished);
+  for(auto stats : reg.threads) {
+    sum.merge(*stats);
+  }
+}
+
+//What the sockets inherit: records into their own Stats and into the thread's totals.
+//With stats compiled out it's empty and every call is a no-op
+template<bool Enabled = Stats::Enabled>
+class Counting {
+  Stats own;
+protected:
+  auto count(Stats::Counts which, std::uint64_t n = 1) noexcept -> void {
+    own.add(which, n);
+    Stats::local().add(which, n);
+  }
+  auto countSent(std::uint64_t messages, std::uint64_t bytes) noexcept -> void {
+    auto& totals = Stats::local();
+    own.add(Stats::MessagesSent, messages);
+    own.add(Stats::BytesSent, bytes);
+    totals.add(Stats::MessagesSent, messages);
+    totals.add(Stats::BytesSent, bytes);
+  }
+  auto countReceived(std::uint64_t messages, std::uint64_t bytes) noexcept -> void {
+    auto& totals = Stats::local();
+    own.add(Stats::MessagesReceived, messages);
+    own.add(Stats::BytesReceived, bytes);
+    totals.add(Stats::MessagesReceived, messages);
+    totals.add(Stats::BytesReceived, bytes);
+  }
+  //Classifies a failed call by errno: would block, still in progress (not counted) or an error
+  auto countFailure(Stats::Calls call) noexcept -> void {
+    if(errno == EAGAIN or errno == EWOULDBLOCK) {
+      count(Stats::WouldBlock);
+    } else if(errno != EINPROGRESS) {
+      own.fail(call);
+      Stats::local().fail(call);
+    }
+  }
+  //Returns what syscall() returns, timing it if the histograms are compiled in
+  template<class Syscall>
+  auto timed(Stats::Calls call, Syscall&& syscall) noexcept -> decltype(syscall()) {
+    if(not Stats::Histograms) {
+      return syscall();
+    }
+    auto start  = std::chrono::steady_clock::now();
+    auto result = syscall();
+    auto duration = std::chrono::steady_clock::now() - start;
+    own.took(call, duration);
+    Stats::local().took(call, duration);
+    return result;
+  }
+  auto pushStats(Lua::State* L) noexcept -> int {
+    own.push(L);
+    return 1;
+  }
+};
+
+template<>
+class Counting<false> {
+protected:
+  auto count(Stats::Counts, std::uint64_t = 1) noexcept -> void {}
+  auto countSent(std::uint64_t, std::uint64_t) noexcept -> void {}
+  auto countReceived(std::uint64_t, std::uint64_t) noexcept -> void {}
+  auto countFailure(Stats::Calls) noexcept -> void {}
+  template<class Syscall>
+  auto timed(Stats::Calls, Syscall&& syscall) noexcept -> decltype(syscall()) { return syscall(); }
+  auto pushStats(Lua::State* L) noexcept -> int {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "stats: disabled at build time");
+    return 2;
+  }
+};
+
+} //namespace Sctp
+
+#endif /* SCTPSTATS_HPP */
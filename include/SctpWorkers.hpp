@@ -0,0 +1,217 @@
+#ifndef SCTPWORKERS_HPP
+#define SCTPWORKERS_HPP
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <functional>
+#include <new>
+#include <cerrno>
+
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "Lua/Lua.hpp"
+#include "SctpServerSocket.hpp"
+
+namespace Sctp {
+
+//OS threads with a Lua state each, all serving the same listening socket.
+//Every worker gets its own server object (a dup of the listening descriptor) and accepts on it,
+//so an association is handled by the worker that accepted it for its whole life.
+//The workers wait in epoll with EPOLLEXCLUSIVE, so a new association wakes only one of them.
+//Stopping makes their accept calls fail with "stopped", so scripts looping on accept can return
+class Workers {
+public:
+  static const char* MetaTableName;
+private:
+  struct Worker {
+    std::thread thread;
+    std::string error;
+  };
+  std::vector<Worker> workers;
+  //An eventfd, readable once the workers have to stop
+  int stopFD;
+public:
+  Workers() noexcept : stopFD(-1) {}
+  ~Workers();
+public:
+  template<int IPVersion>
+  auto start(int listenFD, int count, const char* script, Lua::CFunction openModule) noexcept -> bool;
+  auto join(Lua::State*) noexcept -> int;
+  auto stop(Lua::State*) noexcept -> int;
+private:
+  auto signalStop() noexcept -> void;
+  auto joinAll() noexcept -> void;
+  auto watch(int fd) noexcept -> int;
+  template<int IPVersion>
+  static auto work(int fd, int waitFD, int index, int count, const std::string& script, Lua::CFunction openModule, std::string& error) noexcept -> void;
+};
+
+inline Workers::~Workers() {
+  signalStop();
+  joinAll();
+  if(stopFD > -1) {
+    ::close(stopFD);
+  }
+}
+
+inline auto Workers::signalStop() noexcept -> void {
+  if(stopFD > -1) {
+    uint64_t one = 1;
+    ::write(stopFD, &one, sizeof(uint64_t));
+  }
+}
+
+inline auto Workers::joinAll() noexcept -> void {
+  for(auto& worker : workers) {
+    if(worker.thread.joinable()) {
+      worker.thread.join();
+    }
+  }
+}
+
+//A worker's epoll descriptor: the stop eventfd for every worker, its listening descriptor exclusively
+inline auto Workers::watch(int fd) noexcept -> int {
+  int waitFD = ::epoll_create1(EPOLL_CLOEXEC);
+  if(waitFD < 0) {
+    return -1;
+  }
+  epoll_event ev = {};
+  ev.events  = EPOLLIN;
+  ev.data.fd = stopFD;
+  if(::epoll_ctl(waitFD, EPOLL_CTL_ADD, stopFD, &ev) == 0) {
+    ev.events  = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = fd;
+    if(::epoll_ctl(waitFD, EPOLL_CTL_ADD, fd, &ev) == 0) {
+      return waitFD;
+    }
+  }
+  int error = errno;
+  ::close(waitFD);
+  errno = error;
+  return -1;
+}
+
+//Runs script(server, index, count) in a new state, the state is closed when it returns
+template<int IPVersion>
+auto Workers::work(int fd, int waitFD, int index, int count, const std::string& script, Lua::CFunction openModule, std::string& error) noexcept -> void {
+  auto L = Lua::Aux::NewState();
+  if(L == nullptr) {
+    ::close(fd);
+    ::close(waitFD);
+    error = "Lua state allocation failed";
+    return;
+  }
+  Lua::Lib::Open::Libs(L);
+  Lua::Aux::RequiRef(L, "sctp", openModule, false);
+  Lua::Pop(L, 1);
+
+  auto server = Lua::NewUserData<Socket::Server<IPVersion>>(L);
+  if(server == nullptr) {
+    ::close(fd);
+    ::close(waitFD);
+    error = "Socket userdata allocation failed";
+    Lua::Close(L);
+    return;
+  }
+  new (server) Socket::Server<IPVersion>(fd, waitFD);
+  Lua::Aux::GetMetaTable(L, Socket::Server<IPVersion>::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+
+  if(Lua::Aux::LoadFile(L, script.c_str()) != Lua::Statuses::OK) {
+    error = Lua::ToString(L, -1);
+    Lua::Close(L);
+    return;
+  }
+  Lua::Insert(L, -2);
+  Lua::PushInteger(L, index);
+  Lua::PushInteger(L, count);
+  if(Lua::PCall(L, 3, 0, 0) != Lua::Statuses::OK) {
+    auto message = Lua::ToString(L, -1);
+    error = message == nullptr ? "(error object is not a string)" : message;
+  }
+  Lua::Close(L);
+}
+
+//Starts count workers, each with its own dup of listenFD and epoll descriptor.
+//The descriptors are created up front, so running out of them doesn't leave workers half started.
+//listenFD is made non-blocking (for all the dups), a worker only blocks in epoll
+template<int IPVersion>
+auto Workers::start(int listenFD, int count, const char* script, Lua::CFunction openModule) noexcept -> bool {
+  int flags = ::fcntl(listenFD, F_GETFL);
+  if(flags < 0 or ::fcntl(listenFD, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return false;
+  }
+  stopFD = ::eventfd(0, EFD_CLOEXEC);
+  if(stopFD < 0) {
+    return false;
+  }
+  std::vector<int> fds(count, -1);
+  std::vector<int> waitFDs(count, -1);
+  for(int i = 0; i < count; i++) {
+    fds[i] = ::fcntl(listenFD, F_DUPFD_CLOEXEC, 0);
+    if(fds[i] > -1) {
+      waitFDs[i] = watch(fds[i]);
+    }
+    if(waitFDs[i] < 0) {
+      int error = errno;
+      for(int j = 0; j <= i; j++) {
+        if(fds[j] > -1) {
+          ::close(fds[j]);
+        }
+        if(waitFDs[j] > -1) {
+          ::close(waitFDs[j]);
+        }
+      }
+      errno = error;
+      return false;
+    }
+  }
+
+  workers.resize(count);
+  for(int i = 0; i < count; i++) {
+    try {
+      workers[i].thread = std::thread(work<IPVersion>, fds[i], waitFDs[i], i + 1, count, std::string(script), openModule, std::ref(workers[i].error));
+    } catch(...) {
+      ::close(fds[i]);
+      ::close(waitFDs[i]);
+      workers[i].error = "Thread creation failed";
+    }
+  }
+  return true;
+}
+
+//stop(): the workers' accept calls fail with "stopped" from now on, the ones waiting in accept return right away
+inline auto Workers::stop(Lua::State* L) noexcept -> int {
+  signalStop();
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+//join(): waits for every worker to return. Returns true, or false and a table of the errors by worker index
+inline auto Workers::join(Lua::State* L) noexcept -> int {
+  joinAll();
+  Lua::Newtable(L);
+  bool failed = false;
+  for(std::size_t i = 0; i < workers.size(); i++) {
+    if(not workers[i].error.empty()) {
+      Lua::PushLString(L, workers[i].error.data(), workers[i].error.size());
+      Lua::RawSet(L, -2, static_cast<Lua::Integer>(i + 1));
+      failed = true;
+    }
+  }
+  if(failed) {
+    Lua::PushBoolean(L, false);
+    Lua::Insert(L, -2);
+    return 2;
+  }
+  Lua::PushBoolean(L, true);
+  return 1;
+}
+
+} //namespace Sctp
+
+#endif /* SCTPWORKERS_HPP */
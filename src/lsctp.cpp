@@ -1,9 +1,20 @@
 #include <type_traits>
+#include <thread>
+#include <utility>
+#include <chrono>
 
 #include "Lua/Lua.hpp"
 #include "SctpSocket.hpp"
 #include "SctpServerSocket.hpp"
 #include "SctpClientSocket.hpp"
+#include "SctpSeqPacketSocket.hpp"
+#include "SctpPoller.hpp"
+#include "SctpBuffer.hpp"
+#include "SctpAddressSet.hpp"
+#include "SctpScheduler.hpp"
+#include "SctpIoThread.hpp"
+#include "SctpWorkers.hpp"
+#include "SctpPool.hpp"
 
 namespace Sctp {
 
@@ -17,10 +28,38 @@ template<> const char* Client<4>::MetaTableName = "ClientSocketMeta4";
 
 template<> const char* Client<6>::MetaTableName = "ClientSocketMeta6";
 
+template<> const char* SeqPacket<4>::MetaTableName = "SeqPacketSocketMeta4";
+
+template<> const char* SeqPacket<6>::MetaTableName = "SeqPacketSocketMeta6";
+
 } //namespace Socket
 
+const char* Poller::MetaTableName = "PollerMeta";
+
+const char* Buffer::MetaTableName = "BufferMeta";
+
+const char* AddressSet::MetaTableName = "AddressSetMeta";
+
+const char* Pool::MetaTableName = "PoolMeta";
+
+const char* Scheduler::MetaTableName = "SchedulerMeta";
+
+constexpr uint32_t Scheduler::Read;
+
+constexpr uint32_t Scheduler::Write;
+
+const char Scheduler::TasksKey = 0;
+
+const char Scheduler::YieldMark = 0;
+
+const char* IoThread::MetaTableName = "IoThreadMeta";
+
+const char* Workers::MetaTableName = "WorkersMeta";
+
 } //namespace Sctp
 
+extern "C" int luaopen_sctp(Lua::State* L);
+
 namespace {
 
 template<class SocketType>
@@ -30,20 +69,126 @@ auto UserDataToSocket(Lua::State* L, int idx) -> SocketType* {
   return Lua::Aux::TestUData<SocketType>(L, idx, SocketType::MetaTableName);
 }
 
+//ToFileDescriptor() and SocketClosing() find these in the object's metatable (keyed by the address of the keys below)
+//instead of testing it against every type by name
+using FileDescriptorFunction = int (*)(void* sock);
+using ClosingFunction        = void (*)(Lua::State* L, int watcherIdx, int sockIdx, int fd);
+
+const char FileDescriptorKey = 0;
+const char ClosingKey        = 0;
+
+template<class SocketType>
+auto FileDescriptorOf(void* sock) -> int {
+  return static_cast<SocketType*>(sock)->fileDescriptor();
+}
+
+auto Forget(Lua::State* L, Sctp::Poller* poller, int watcherIdx, int sockIdx, int fd) -> void {
+  poller->forget(L, watcherIdx, sockIdx, fd);
+}
+
+auto Forget(Lua::State* L, Sctp::Scheduler* scheduler, int watcherIdx, int, int fd) -> void {
+  scheduler->forget(L, watcherIdx, fd);
+}
+
+auto Forget(Lua::State* L, Sctp::IoThread* ioThread, int watcherIdx, int sockIdx, int fd) -> void {
+  ioThread->forget(L, watcherIdx, sockIdx, fd);
+}
+
+auto Forget(Lua::State* L, Sctp::Pool*, int watcherIdx, int sockIdx, int) -> void {
+  Sctp::Pool::forget(L, watcherIdx, sockIdx);
+}
+
+template<class WatcherType>
+auto ForgetSocket(Lua::State* L, int watcherIdx, int sockIdx, int fd) -> void {
+  Forget(L, static_cast<WatcherType*>(Lua::ToUserData(L, watcherIdx)), watcherIdx, sockIdx, fd);
+}
+
+template<class SocketType>
+const FileDescriptorFunction FileDescriptorAccessor = FileDescriptorOf<SocketType>;
+
+template<class WatcherType>
+const ClosingFunction ClosingAccessor = ForgetSocket<WatcherType>;
+
+//The accessor stored under key in the metatable of the full userdata at idx, nullptr if there is none
+template<class Function>
+auto MetaTableAccessor(Lua::State* L, int idx, const char& key) -> const Function* {
+  if(Lua::Type(L, idx) != Lua::Types::UserData or Lua::GetMetaTable(L, idx) == Lua::Types::Nil) {
+    return nullptr;
+  }
+  Lua::RawGet(L, -1, &key);
+  auto accessor = static_cast<const Function*>(Lua::ToUserData(L, -1));
+  Lua::Pop(L, 2);
+  return accessor;
+}
+
+template<class Type, class Function>
+auto SetMetaTableAccessor(Lua::State* L, const char& key, const Function& accessor) -> void {
+  Lua::Aux::GetMetaTable(L, Type::MetaTableName);
+  Lua::PushLightUserData(L, const_cast<Function*>(&accessor));
+  Lua::RawSet(L, -2, &key);
+  Lua::Pop(L, 1);
+}
+
+//The object the method was called on. Methods get their metatable as upvalue 1 (see RegisterMetaTable),
+//so this compares two pointers instead of looking the metatable up in the registry by name
+template<class Type>
+auto ToSelf(Lua::State* L) -> Type* {
+  auto self = static_cast<Type*>(Lua::ToUserData(L, 1));
+  //lua_getmetatable() returns 0 (Nil) if there is none
+  if(self == nullptr or Lua::GetMetaTable(L, 1) == Lua::Types::Nil) {
+    return nullptr;
+  }
+  bool isType = Lua::RawEqual(L, -1, Lua::UpvalueIndex(1));
+  Lua::Pop(L, 1);
+  return isType ? self : nullptr;
+}
+
+//Creates the metatable of Type, which is its own __index, with the methods getting it as upvalue 1
+template<class Type>
+auto RegisterMetaTable(Lua::State* L, const Lua::Aux::Reg* methods) -> void {
+  Lua::Aux::NewMetaTable(L, Type::MetaTableName);
+  Lua::PushValue(L, -1);
+  Lua::SetField(L, -2, "__index");
+  Lua::PushValue(L, -1);
+  Lua::Aux::SetFuncs(L, methods, 1);
+  Lua::Pop(L, 1);
+}
+
+template<class SocketType>
+auto Construct(Lua::State*, SocketType* sock) -> void {
+  new (sock) SocketType();
+}
+
+//Message sockets optionally take their initial receive buffer size
+template<int IPVersion>
+auto Construct(Lua::State* L, Sctp::Socket::Client<IPVersion>* sock) -> void {
+  new (sock) Sctp::Socket::Client<IPVersion>(static_cast<std::size_t>(Lua::Aux::OptInteger(L, 1, Sctp::RecvBuffer::DefaultSize)));
+}
+
+template<int IPVersion>
+auto Construct(Lua::State* L, Sctp::Socket::SeqPacket<IPVersion>* sock) -> void {
+  new (sock) Sctp::Socket::SeqPacket<IPVersion>(static_cast<std::size_t>(Lua::Aux::OptInteger(L, 1, Sctp::RecvBuffer::DefaultSize)));
+}
+
 template<class SocketType>
 auto New(Lua::State* L) -> int {
   static_assert(Sctp::IsSctpSocket<SocketType>::value, "");
 
+  //Construct() may read an argument at 1, which mustn't be the new userdata when there's none
+  Lua::SetTop(L, 1);
   auto sock = Lua::NewUserData<SocketType>(L);
   if(sock == nullptr) {
     Lua::PushNil(L);
     Lua::PushString(L, "Socket userdata allocation failed");
     return 2;
   }
-  new (sock) SocketType();
+  Construct(L, sock);
   if (not sock->create()) {
+    //Without a metatable there is no __gc, so the descriptor (if any) and the buffers are released here
+    int error = errno;
+    sock->SocketType::~SocketType();
     Lua::PushBoolean(L, false);
-    Lua::PushFString(L, "socket(): %s", std::strerror(errno));
+    Lua::PushFString(L, "socket(): %s", std::strerror(error));
     return 2;
   }
 
@@ -59,7 +204,7 @@ template<int IPVersion,  template<int> class SocketType, MemberFuncType<IPVersio
 auto CallMemberFunction(Lua::State* L) -> int {
   static_assert(Sctp::IsSctpSocket<SocketType<IPVersion>>::value, "");
 
-  auto sock = UserDataToSocket<SocketType<IPVersion>>(L, 1);
+  auto sock = ToSelf<SocketType<IPVersion>>(L);
   if  (sock == nullptr) {
     Lua::PushBoolean(L, false);
     Lua::PushFString(L, "Can\'t call function, pointer is nil.");
@@ -72,7 +217,7 @@ template<int IPVersion,  template<int> class SocketType, MemberFuncType<IPVersio
 auto CallMemberFunction(Lua::State* L) -> int {
   static_assert(Sctp::IsSctpSocket<SocketType<IPVersion>>::value, "");
 
-  auto sock = UserDataToSocket<SocketType<IPVersion>>(L, 1);
+  auto sock = ToSelf<SocketType<IPVersion>>(L);
   if  (sock == nullptr) {
     Lua::PushBoolean(L, false);
     Lua::PushFString(L, "Can\'t call function, pointer is nil.");
@@ -82,92 +227,610 @@ auto CallMemberFunction(Lua::State* L) -> int {
   return (basePtr->*fn)(L);
 }
 
+template<int IPVersion,  template<int> class SocketType, MemberFuncType<IPVersion, SocketType> fn, uint32_t events>
+auto CallYieldingMemberFunction(Lua::State* L) -> int;
+
+template<int IPVersion,  template<int> class SocketType, MemberFuncType<IPVersion, SocketType> fn, uint32_t events>
+auto ContinueYieldingMemberFunction(Lua::State* L, int, Lua::KContext) -> int {
+  return CallYieldingMemberFunction<IPVersion, SocketType, fn, events>(L);
+}
+
+//Same as CallMemberFunction, but when called from a scheduler task and the call would block,
+//the task yields until the socket is ready for events, then the call is made again with the same arguments
+template<int IPVersion,  template<int> class SocketType, MemberFuncType<IPVersion, SocketType> fn, uint32_t events>
+auto CallYieldingMemberFunction(Lua::State* L) -> int {
+  static_assert(Sctp::IsSctpSocket<SocketType<IPVersion>>::value, "");
+
+  auto sock = ToSelf<SocketType<IPVersion>>(L);
+  if  (sock == nullptr) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "Can\'t call function, pointer is nil.");
+    return 2;
+  }
+  int numArgs = Lua::GetTop(L);
+  sock->resetWouldBlock();
+  int numResults = (sock->*fn)(L);
+  if(not sock->wouldBlock() or not Sctp::Scheduler::isTask(L)) {
+    return numResults;
+  }
+  Lua::SetTop(L, numArgs);
+  return Sctp::Scheduler::yield(L, 1, sock->fileDescriptor(), events, ContinueYieldingMemberFunction<IPVersion, SocketType, fn, events>);
+}
+
 template<class SocketType>
 auto DestroySocket(Lua::State* L) noexcept -> int {
   static_assert(Sctp::IsSctpSocket<SocketType>::value, "");
 
-  auto sock = UserDataToSocket<SocketType>(L, 1);
+  auto sock = ToSelf<SocketType>(L);
   sock->SocketType::~SocketType();
   return 0;
 }
 
+auto NewPoller(Lua::State* L) -> int {
+  auto poller = Lua::NewUserData<Sctp::Poller>(L);
+  if(poller == nullptr) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "Poller userdata allocation failed");
+    return 2;
+  }
+  new (poller) Sctp::Poller();
+  if(not poller->create()) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "epoll_create1(): %s", std::strerror(errno));
+    return 2;
+  }
+
+  Lua::Newtable(L);
+  Lua::SetUserValue(L, -2);
+  Lua::Aux::GetMetaTable(L, Sctp::Poller::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  return 1;
+}
+
+auto NewScheduler(Lua::State* L) -> int {
+  auto scheduler = Lua::NewUserData<Sctp::Scheduler>(L);
+  if(scheduler == nullptr) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "Scheduler userdata allocation failed");
+    return 2;
+  }
+  new (scheduler) Sctp::Scheduler();
+  Lua::Aux::GetMetaTable(L, Sctp::Scheduler::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  if(not scheduler->create(L)) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "epoll_create1(): %s", std::strerror(errno));
+    return 2;
+  }
+  return 1;
+}
+
+auto NewIoThread(Lua::State* L) -> int {
+  auto capacity = Lua::Aux::OptInteger(L, 1, Sctp::IoThread::DefaultCapacity);
+  Lua::Aux::ArgCheck(L, capacity > 0, 1, "must be positive");
+  auto ioThread = Lua::NewUserData<Sctp::IoThread>(L);
+  if(ioThread == nullptr) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "IoThread userdata allocation failed");
+    return 2;
+  }
+  new (ioThread) Sctp::IoThread(static_cast<std::size_t>(capacity));
+  Lua::Aux::GetMetaTable(L, Sctp::IoThread::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  if(not ioThread->create()) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "IoThread: %s", std::strerror(errno));
+    return 2;
+  }
+
+  Lua::Newtable(L);
+  Lua::SetUserValue(L, -2);
+  return 1;
+}
+
+//Opens the listening socket on the caller's state, the workers get dups of it
+template<int IPVersion>
+auto StartWorkers(Lua::State* L, int addrsIdx, Lua::Integer port, Lua::Integer backLog, int count, const char* script) -> int {
+  using Server = Sctp::Socket::Server<IPVersion>;
+  //Called through Lua, since New() takes the stack as its own arguments
+  Lua::PushCFunction(L, New<Server>);
+  Lua::Call(L, 0, 2);
+  if(not Lua::ToBoolean(L, -2)) {
+    return 2;
+  }
+  Lua::Pop(L, 1);
+  int serverIdx = Lua::GetTop(L);
+
+  Lua::GetField(L, serverIdx, "bind");
+  Lua::PushValue(L, serverIdx);
+  Lua::PushInteger(L, port);
+  int numAddrs = 0;
+  if(Lua::IsTable(L, addrsIdx)) {
+    for(Lua::Integer i = 1; Lua::RawGet(L, addrsIdx, i) != Lua::Types::Nil; i++) {
+      numAddrs++;
+    }
+    Lua::Pop(L, 1);
+  } else {
+    Lua::PushValue(L, addrsIdx);
+    numAddrs = 1;
+  }
+  Lua::Call(L, numAddrs + 2, 2);
+  if(not Lua::ToBoolean(L, -2)) {
+    return 2;
+  }
+  Lua::Pop(L, 2);
+
+  Lua::GetField(L, serverIdx, "listen");
+  Lua::PushValue(L, serverIdx);
+  Lua::PushInteger(L, backLog);
+  Lua::Call(L, 2, 2);
+  if(not Lua::ToBoolean(L, -2)) {
+    return 2;
+  }
+  Lua::Pop(L, 2);
+
+  auto workers = Lua::NewUserData<Sctp::Workers>(L);
+  if(workers == nullptr) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "Workers userdata allocation failed");
+    return 2;
+  }
+  new (workers) Sctp::Workers();
+  Lua::Aux::GetMetaTable(L, Sctp::Workers::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  Lua::PushValue(L, serverIdx);
+  Lua::SetUserValue(L, -2);
+
+  auto server = UserDataToSocket<Server>(L, serverIdx);
+  if(not workers->start<IPVersion>(server->fileDescriptor(), count, script, luaopen_sctp)) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "serve_workers: %s", std::strerror(errno));
+    return 2;
+  }
+  return 1;
+}
+
+//serve_workers{ port = , addrs = , workers = N, script = [, ipv6 = false] [, backlog = 1000] }
+auto ServeWorkers(Lua::State* L) -> int {
+  Lua::Aux::CheckType(L, 1, static_cast<int>(Lua::Types::Table));
+  Lua::SetTop(L, 1);
+  Lua::GetField(L, 1, "addrs");
+  Lua::GetField(L, 1, "port");
+  Lua::GetField(L, 1, "script");
+  Lua::GetField(L, 1, "workers");
+  Lua::GetField(L, 1, "ipv6");
+  Lua::GetField(L, 1, "backlog");
+  Lua::Aux::ArgCheck(L, Lua::IsTable(L, 2) or Lua::IsString(L, 2), 1, "addrs must be an address or an array of them");
+  Lua::Aux::ArgCheck(L, Lua::IsInteger(L, 3), 1, "port must be an integer");
+  Lua::Aux::ArgCheck(L, Lua::IsString(L, 4), 1, "script must be a file name");
+
+  auto port    = Lua::ToInteger(L, 3);
+  auto script  = Lua::ToString(L, 4);
+  auto count   = Lua::IsNoneOrNil(L, 5) ? static_cast<Lua::Integer>(std::thread::hardware_concurrency()) : Lua::ToInteger(L, 5);
+  auto backLog = Lua::IsNoneOrNil(L, 7) ? static_cast<Lua::Integer>(Sctp::Socket::Server<4>::DefaultBackLogSize) : Lua::ToInteger(L, 7);
+  if(count < 1) {
+    count = 1;
+  }
+  if(Lua::ToBoolean(L, 6)) {
+    return StartWorkers<6>(L, 2, port, backLog, static_cast<int>(count), script);
+  }
+  return StartWorkers<4>(L, 2, port, backLog, static_cast<int>(count), script);
+}
+
+//connectmany(specs): calls sock:connect(...) for every { sock, port, addr1, ... } or { sock, addrset } entry,
+//so on non-blocking sockets all the handshakes run at once. Returns the number of associations
+//connected or in progress, their ids (false for the failed ones) and the errors, both by entry index
+auto ConnectMany(Lua::State* L) -> int {
+  Lua::Aux::CheckType(L, 1, static_cast<int>(Lua::Types::Table));
+  Lua::SetTop(L, 1);
+  auto count = static_cast<Lua::Integer>(Lua::RawLen(L, 1));
+  Lua::CreateTable(L, static_cast<int>(count), 0);
+  Lua::Newtable(L);
+  const int idsIdx    = 2;
+  const int errorsIdx = 3;
+  const int specIdx   = 4;
+
+  Lua::Integer started = 0;
+  for(Lua::Integer i = 1; i <= count; i++) {
+    Lua::Aux::ArgCheck(L, Lua::RawGet(L, 1, i) == Lua::Types::Table, 1, "entries must be { sock, port, addr1, ... } tables");
+    auto numFields = static_cast<Lua::Integer>(Lua::RawLen(L, specIdx));
+    Lua::RawGet(L, specIdx, static_cast<Lua::Integer>(1));
+    Lua::Aux::ArgCheck(L, Lua::IsUserData(L, -1), 1, "entries must start with a socket");
+    Lua::GetField(L, -1, "connect");
+    Lua::Insert(L, -2);
+    for(Lua::Integer j = 2; j <= numFields; j++) {
+      Lua::RawGet(L, specIdx, j);
+    }
+    if(Lua::PCall(L, static_cast<int>(numFields), 3, 0) != Lua::Statuses::OK) {
+      Lua::PushBoolean(L, false);
+      Lua::RawSet(L, idsIdx, i);
+      Lua::RawSet(L, errorsIdx, i);
+    } else if(Lua::ToBoolean(L, -3)) {
+      Lua::PushValue(L, -2);
+      Lua::RawSet(L, idsIdx, i);
+      started++;
+    } else if(Lua::IsString(L, -2) and std::strcmp(Lua::ToString(L, -2), "EINPROGRESS") == 0) {
+      Lua::RawSet(L, idsIdx, i);
+      started++;
+    } else {
+      Lua::PushBoolean(L, false);
+      Lua::RawSet(L, idsIdx, i);
+      Lua::PushValue(L, -2);
+      Lua::RawSet(L, errorsIdx, i);
+    }
+    Lua::SetTop(L, errorsIdx);
+  }
+  Lua::PushInteger(L, started);
+  Lua::Insert(L, idsIdx);
+  return 3;
+}
+
+auto NewBuffer(Lua::State* L) -> int {
+  auto size = Lua::Aux::CheckInteger(L, 1);
+  Lua::Aux::ArgCheck(L, size > 0, 1, "must be positive");
+  auto buf = Lua::NewUserData<Sctp::Buffer>(L);
+  if(buf == nullptr) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "Buffer userdata allocation failed");
+    return 2;
+  }
+  new (buf) Sctp::Buffer(static_cast<std::size_t>(size));
+  Lua::Aux::GetMetaTable(L, Sctp::Buffer::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  if(not buf->valid()) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "Buffer allocation failed");
+    return 2;
+  }
+  return 1;
+}
+
+//addrset(port, addr1, ...)
+auto NewAddressSet(Lua::State* L) -> int {
+  Sctp::AddressSet addresses;
+  int loadResult = addresses.load(L, 1);
+  if(loadResult > 0) {
+    return loadResult;
+  }
+  auto set = Lua::NewUserData<Sctp::AddressSet>(L);
+  if(set == nullptr) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "AddressSet userdata allocation failed");
+    return 2;
+  }
+  new (set) Sctp::AddressSet(std::move(addresses));
+  Lua::Aux::GetMetaTable(L, Sctp::AddressSet::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  return 1;
+}
+
+//clock(): seconds of a monotonic clock, for timing
+auto Clock(Lua::State* L) -> int {
+  using namespace std::chrono;
+  Lua::PushNumber(L, duration_cast<duration<Lua::Number>>(steady_clock::now().time_since_epoch()).count());
+  return 1;
+}
+
+//stats(): the counters of every socket of the process summed up, in the format of sock:stats()
+auto ModuleStats(Lua::State* L) -> int {
+  if(not Sctp::Stats::Enabled) {
+    Lua::PushBoolean(L, false);
+    Lua::PushString(L, "stats: disabled at build time");
+    return 2;
+  }
+  Sctp::Stats sum;
+  Sctp::Stats::total(sum);
+  sum.push(L);
+  return 1;
+}
+
+//pool([{ max_per_peer = 8, idle = 60000 (milliseconds), recvbuffer = 5000 }])
+auto NewPool(Lua::State* L) -> int {
+  Lua::Integer maxPerPeer     = Sctp::Pool::DefaultMaxPerPeer;
+  Lua::Integer idleTimeout    = Sctp::Pool::DefaultIdleTimeout;
+  Lua::Integer recvBufferSize = Sctp::RecvBuffer::DefaultSize;
+  if(Lua::IsTable(L, 1)) {
+    if(Lua::GetField(L, 1, "max_per_peer") != Lua::Types::Nil) {
+      maxPerPeer = Lua::ToInteger(L, -1);
+    }
+    if(Lua::GetField(L, 1, "idle") != Lua::Types::Nil) {
+      idleTimeout = Lua::ToInteger(L, -1);
+    }
+    if(Lua::GetField(L, 1, "recvbuffer") != Lua::Types::Nil) {
+      recvBufferSize = Lua::ToInteger(L, -1);
+    }
+    Lua::Pop(L, 3);
+  }
+  Lua::Aux::ArgCheck(L, maxPerPeer > 0 and recvBufferSize > 0, 1, "max_per_peer and recvbuffer must be positive");
+  auto pool = Lua::NewUserData<Sctp::Pool>(L);
+  if(pool == nullptr) {
+    Lua::PushNil(L);
+    Lua::PushString(L, "Pool userdata allocation failed");
+    return 2;
+  }
+  new (pool) Sctp::Pool(static_cast<int>(maxPerPeer), idleTimeout, recvBufferSize);
+  Lua::Aux::GetMetaTable(L, Sctp::Pool::MetaTableName);
+  Lua::SetMetaTable(L, -2);
+  Sctp::Pool::create(L, New<Sctp::Socket::Client<4>>, New<Sctp::Socket::Client<6>>);
+  return 1;
+}
+
+//Same as CallMemberFunction, for the non-socket types of the module
+template<class Type, int (Type::*fn)(Lua::State*)>
+auto CallObjectFunction(Lua::State* L) -> int {
+  auto obj = ToSelf<Type>(L);
+  if(obj == nullptr) {
+    Lua::PushBoolean(L, false);
+    Lua::PushFString(L, "Can\'t call function, pointer is nil.");
+    return 2;
+  }
+  return (obj->*fn)(L);
+}
+
+template<class Type>
+auto DestroyObject(Lua::State* L) noexcept -> int {
+  auto obj = ToSelf<Type>(L);
+  obj->~Type();
+  return 0;
+}
+
 //I haven't found a way yet to keep array of structures in the format below
 //So for now, clang-format is off-limits
 // clang-format off
-const Lua::Aux::Reg ServerSocketMetaTable4[] = {
-  { "bind",           CallMemberFunction<4, Sctp::Socket::Server, &Sctp::Socket::Server<4>::bind> },
-  { "close",          CallMemberFunction<4, Sctp::Socket::Server, &Sctp::Socket::Server<4>::close> },
-  { "listen",         CallMemberFunction<4, Sctp::Socket::Server, &Sctp::Socket::Server<4>::listen> },
-  { "accept",         CallMemberFunction<4, Sctp::Socket::Server, &Sctp::Socket::Server<4>::accept> },
-  { "setnonblocking", CallMemberFunction<4, Sctp::Socket::Server, &Sctp::Socket::Server<4>::setNonBlocking> },
-  { "__gc",           DestroySocket<Sctp::Socket::Server<4>> },
+
+//The methods of the SocketType<IPVersion> metatable, one specialization per socket type
+template<template<int> class SocketType, int IPVersion>
+struct SocketMetaTable;
+
+template<int IPVersion>
+struct SocketMetaTable<Sctp::Socket::Server, IPVersion> {
+  static const Lua::Aux::Reg methods[];
+};
+
+template<int IPVersion>
+const Lua::Aux::Reg SocketMetaTable<Sctp::Socket::Server, IPVersion>::methods[] = {
+  { "bind",           CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::bind> },
+  { "close",          CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::close> },
+  { "listen",         CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::listen> },
+  { "accept",         CallYieldingMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::accept, Sctp::Scheduler::Read> },
+  { "acceptmany",     CallYieldingMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::acceptmany, Sctp::Scheduler::Read> },
+  { "setnonblocking", CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::setNonBlocking> },
+  { "subscribe",      CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::subscribe> },
+  { "setopt",         CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::setopt> },
+  { "getopt",         CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::getopt> },
+  { "getladdrs",      CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::getLocalAddresses> },
+  { "stats",          CallMemberFunction<IPVersion, Sctp::Socket::Server, &Sctp::Socket::Server<IPVersion>::stats> },
+  { "__gc",           DestroySocket<Sctp::Socket::Server<IPVersion>> },
+  { nullptr, nullptr }
+};
+
+template<int IPVersion>
+struct SocketMetaTable<Sctp::Socket::Client, IPVersion> {
+  static const Lua::Aux::Reg methods[];
+};
+
+template<int IPVersion>
+const Lua::Aux::Reg SocketMetaTable<Sctp::Socket::Client, IPVersion>::methods[] = {
+  { "bind",           CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::bind> },
+  { "connect",        CallYieldingMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::connect, Sctp::Scheduler::Write> },
+  { "send",           CallYieldingMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::sendmsg, Sctp::Scheduler::Write> },
+  { "sendmany",       CallYieldingMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::sendmany, Sctp::Scheduler::Write> },
+  { "recv",           CallYieldingMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::recvmsg, Sctp::Scheduler::Read> },
+  { "recvmany",       CallYieldingMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::recvmany, Sctp::Scheduler::Read> },
+  { "recv_into",      CallYieldingMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::recvInto, Sctp::Scheduler::Read> },
+  { "setrecvbuffer",  CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::setRecvBufferSize> },
+  { "close",          CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::close> },
+  { "setnonblocking", CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::setNonBlocking> },
+  { "subscribe",      CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::subscribe> },
+  { "setopt",         CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::setopt> },
+  { "getopt",         CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::getopt> },
+  { "getpaddrs",      CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::getPeerAddresses> },
+  { "getladdrs",      CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::getLocalAddresses> },
+  { "setpriority",    CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::setPriority> },
+  { "getpriority",    CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::getPriority> },
+  { "abandoned",      CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::abandoned> },
+  { "stats",          CallMemberFunction<IPVersion, Sctp::Socket::Client, &Sctp::Socket::Client<IPVersion>::stats> },
+  { "__gc",           DestroySocket<Sctp::Socket::Client<IPVersion>> },
+  { nullptr, nullptr }
+};
+
+template<int IPVersion>
+struct SocketMetaTable<Sctp::Socket::SeqPacket, IPVersion> {
+  static const Lua::Aux::Reg methods[];
+};
+
+template<int IPVersion>
+const Lua::Aux::Reg SocketMetaTable<Sctp::Socket::SeqPacket, IPVersion>::methods[] = {
+  { "bind",           CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::bind> },
+  { "listen",         CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::listen> },
+  { "connect",        CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::connect> },
+  { "send",           CallYieldingMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::sendmsg, Sctp::Scheduler::Write> },
+  { "sendmany",       CallYieldingMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::sendmany, Sctp::Scheduler::Write> },
+  { "recv",           CallYieldingMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::recvmsg, Sctp::Scheduler::Read> },
+  { "recvmany",       CallYieldingMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::recvmany, Sctp::Scheduler::Read> },
+  { "recv_into",      CallYieldingMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::recvInto, Sctp::Scheduler::Read> },
+  { "peeloff",        CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::peeloff> },
+  { "setrecvbuffer",  CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::setRecvBufferSize> },
+  { "close",          CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::close> },
+  { "setnonblocking", CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::setNonBlocking> },
+  { "subscribe",      CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::subscribe> },
+  { "setopt",         CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::setopt> },
+  { "getopt",         CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::getopt> },
+  { "getpaddrs",      CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::getPeerAddresses> },
+  { "getladdrs",      CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::getLocalAddresses> },
+  { "setpriority",    CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::setPriority> },
+  { "getpriority",    CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::getPriority> },
+  { "abandoned",      CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::abandoned> },
+  { "stats",          CallMemberFunction<IPVersion, Sctp::Socket::SeqPacket, &Sctp::Socket::SeqPacket<IPVersion>::stats> },
+  { "__gc",           DestroySocket<Sctp::Socket::SeqPacket<IPVersion>> },
   { nullptr, nullptr }
 };
 
-const Lua::Aux::Reg ServerSocketMetaTable6[] = {
-  { "bind",           CallMemberFunction<6, Sctp::Socket::Server, &Sctp::Socket::Server<6>::bind> },
-  { "close",          CallMemberFunction<6, Sctp::Socket::Server, &Sctp::Socket::Server<6>::close> },
-  { "listen",         CallMemberFunction<6, Sctp::Socket::Server, &Sctp::Socket::Server<6>::listen> },
-  { "accept",         CallMemberFunction<6, Sctp::Socket::Server, &Sctp::Socket::Server<6>::accept> },
-  { "setnonblocking", CallMemberFunction<6, Sctp::Socket::Server, &Sctp::Socket::Server<6>::setNonBlocking> },
-  { "__gc",           DestroySocket<Sctp::Socket::Server<6>> },
+const Lua::Aux::Reg PollerMetaTable[] = {
+  { "add",            CallObjectFunction<Sctp::Poller, &Sctp::Poller::add> },
+  { "modify",         CallObjectFunction<Sctp::Poller, &Sctp::Poller::modify> },
+  { "remove",         CallObjectFunction<Sctp::Poller, &Sctp::Poller::remove> },
+  { "wait",           CallObjectFunction<Sctp::Poller, &Sctp::Poller::wait> },
+  { "close",          CallObjectFunction<Sctp::Poller, &Sctp::Poller::close> },
+  { "__gc",           DestroyObject<Sctp::Poller> },
   { nullptr, nullptr }
 };
 
-const Lua::Aux::Reg ClientSocketMetaTable4[] = {
-  { "bind",           CallMemberFunction<4, Sctp::Socket::Client, &Sctp::Socket::Client<4>::bind> },
-  { "connect",        CallMemberFunction<4, Sctp::Socket::Client, &Sctp::Socket::Client<4>::connect> },
-  { "send",           CallMemberFunction<4, Sctp::Socket::Client, &Sctp::Socket::Client<4>::sendmsg> },
-  { "recv",           CallMemberFunction<4, Sctp::Socket::Client, &Sctp::Socket::Client<4>::recvmsg> },
-  { "close",          CallMemberFunction<4, Sctp::Socket::Client, &Sctp::Socket::Client<4>::close> },
-  { "setnonblocking", CallMemberFunction<4, Sctp::Socket::Client, &Sctp::Socket::Client<4>::setNonBlocking> },
-  { "__gc",           DestroySocket<Sctp::Socket::Client<4>> },
+const Lua::Aux::Reg SchedulerMetaTable[] = {
+  { "spawn",          CallObjectFunction<Sctp::Scheduler, &Sctp::Scheduler::spawn> },
+  { "run",            CallObjectFunction<Sctp::Scheduler, &Sctp::Scheduler::run> },
+  { "__gc",           DestroyObject<Sctp::Scheduler> },
   { nullptr, nullptr }
 };
 
-const Lua::Aux::Reg ClientSocketMetaTable6[] = {
-  { "bind",           CallMemberFunction<6, Sctp::Socket::Client, &Sctp::Socket::Client<6>::bind> },
-  { "connect",        CallMemberFunction<6, Sctp::Socket::Client, &Sctp::Socket::Client<6>::connect> },
-  { "send",           CallMemberFunction<6, Sctp::Socket::Client, &Sctp::Socket::Client<6>::sendmsg> },
-  { "recv",           CallMemberFunction<6, Sctp::Socket::Client, &Sctp::Socket::Client<6>::recvmsg> },
-  { "close",          CallMemberFunction<6, Sctp::Socket::Client, &Sctp::Socket::Client<6>::close> },
-  { "setnonblocking", CallMemberFunction<6, Sctp::Socket::Client, &Sctp::Socket::Client<6>::setNonBlocking> },
-  { "__gc",           DestroySocket<Sctp::Socket::Client<6>> },
+const Lua::Aux::Reg IoThreadMetaTable[] = {
+  { "attach",         CallObjectFunction<Sctp::IoThread, &Sctp::IoThread::attach> },
+  { "detach",         CallObjectFunction<Sctp::IoThread, &Sctp::IoThread::detach> },
+  { "send",           CallObjectFunction<Sctp::IoThread, &Sctp::IoThread::send> },
+  { "poll",           CallObjectFunction<Sctp::IoThread, &Sctp::IoThread::poll> },
+  { "wait",           CallObjectFunction<Sctp::IoThread, &Sctp::IoThread::wait> },
+  { "close",          CallObjectFunction<Sctp::IoThread, &Sctp::IoThread::close> },
+  { "__gc",           DestroyObject<Sctp::IoThread> },
+  { nullptr, nullptr }
+};
+
+const Lua::Aux::Reg WorkersMetaTable[] = {
+  { "join",           CallObjectFunction<Sctp::Workers, &Sctp::Workers::join> },
+  { "stop",           CallObjectFunction<Sctp::Workers, &Sctp::Workers::stop> },
+  { "__gc",           DestroyObject<Sctp::Workers> },
+  { nullptr, nullptr }
+};
+
+const Lua::Aux::Reg BufferMetaTable[] = {
+  { "len",            CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::len> },
+  { "u8",             CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::get<uint8_t>> },
+  { "u16",            CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::get<uint16_t>> },
+  { "u32",            CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::get<uint32_t>> },
+  { "u64",            CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::get<uint64_t>> },
+  { "setu8",          CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::set<uint8_t>> },
+  { "setu16",         CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::set<uint16_t>> },
+  { "setu32",         CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::set<uint32_t>> },
+  { "setu64",         CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::set<uint64_t>> },
+  { "string",         CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::getString> },
+  { "setstring",      CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::setString> },
+  { "fill",           CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::fill> },
+  { "__len",          CallObjectFunction<Sctp::Buffer, &Sctp::Buffer::len> },
+  { "__gc",           DestroyObject<Sctp::Buffer> },
+  { nullptr, nullptr }
+};
+
+const Lua::Aux::Reg PoolMetaTable[] = {
+  { "acquire",        CallObjectFunction<Sctp::Pool, &Sctp::Pool::acquire> },
+  { "release",        CallObjectFunction<Sctp::Pool, &Sctp::Pool::release> },
+  { "expire",         CallObjectFunction<Sctp::Pool, &Sctp::Pool::expire> },
+  { "size",           CallObjectFunction<Sctp::Pool, &Sctp::Pool::size> },
+  { "close",          CallObjectFunction<Sctp::Pool, &Sctp::Pool::close> },
+  { "__gc",           DestroyObject<Sctp::Pool> },
+  { nullptr, nullptr }
+};
+
+const Lua::Aux::Reg AddressSetMetaTable[] = {
+  { "__len",          CallObjectFunction<Sctp::AddressSet, &Sctp::AddressSet::len> },
+  { "__gc",           DestroyObject<Sctp::AddressSet> },
   { nullptr, nullptr }
 };
 // clang-format on
 
+template<template<int> class SocketType, int IPVersion>
+auto RegisterSocketMetaTable(Lua::State* L) -> void {
+  RegisterMetaTable<SocketType<IPVersion>>(L, SocketMetaTable<SocketType, IPVersion>::methods);
+  SetMetaTableAccessor<SocketType<IPVersion>>(L, FileDescriptorKey, FileDescriptorAccessor<SocketType<IPVersion>>);
+}
+
+//Watchers are told about closing sockets by SocketClosing()
+template<class WatcherType>
+auto RegisterWatcherMetaTable(Lua::State* L, const Lua::Aux::Reg* methods) -> void {
+  RegisterMetaTable<WatcherType>(L, methods);
+  SetMetaTableAccessor<WatcherType>(L, ClosingKey, ClosingAccessor<WatcherType>);
+}
+
 } //anonymous namespace
 
-extern "C" int luaopen_sctp(Lua::State* L) {
-  Lua::Aux::NewMetaTable(L, Sctp::Socket::Server<4>::MetaTableName);
-  Lua::PushValue(L, -1);
-  Lua::SetField(L, -2, "__index");
-  Lua::Aux::SetFuncs(L, ServerSocketMetaTable4, 0);
+namespace Sctp {
 
-  Lua::Aux::NewMetaTable(L, Sctp::Socket::Server<6>::MetaTableName);
-  Lua::PushValue(L, -1);
-  Lua::SetField(L, -2, "__index");
-  Lua::Aux::SetFuncs(L, ServerSocketMetaTable6, 0);
+auto ToFileDescriptor(Lua::State* L, int idx) noexcept -> int {
+  auto accessor = MetaTableAccessor<FileDescriptorFunction>(L, idx, FileDescriptorKey);
+  return accessor != nullptr ? (*accessor)(Lua::ToUserData(L, idx)) : -1;
+}
 
-  Lua::Aux::NewMetaTable(L, Sctp::Socket::Client<4>::MetaTableName);
-  Lua::PushValue(L, -1);
-  Lua::SetField(L, -2, "__index");
-  Lua::Aux::SetFuncs(L, ClientSocketMetaTable4, 0);
+auto SocketClosing(Lua::State* L, int sockIdx, int fd) noexcept -> void {
+  if(Lua::GetUserValue(L, sockIdx) != Lua::Types::Table) {
+    Lua::Pop(L, 1);
+    return;
+  }
+  if(Lua::RawGet(L, -1, WatchersSlot) != Lua::Types::Table) {
+    Lua::Pop(L, 2);
+    return;
+  }
+  const int watchersIdx = Lua::GetTop(L);
+  Lua::PushNil(L);
+  while(Lua::Next(L, watchersIdx) != 0) {
+    Lua::Pop(L, 1);
+    if(auto forget = MetaTableAccessor<ClosingFunction>(L, -1, ClosingKey)) {
+      (*forget)(L, Lua::GetTop(L), sockIdx, fd);
+    }
+  }
+  Lua::Pop(L, 2);
+}
 
-  Lua::Aux::NewMetaTable(L, Sctp::Socket::Client<6>::MetaTableName);
-  Lua::PushValue(L, -1);
-  Lua::SetField(L, -2, "__index");
-  Lua::Aux::SetFuncs(L, ClientSocketMetaTable6, 0);
+} //namespace Sctp
 
-  const Lua::Aux::Reg SocketFuncs[] = { { nullptr, nullptr } };
+extern "C" int luaopen_sctp(Lua::State* L) {
+  RegisterSocketMetaTable<Sctp::Socket::Server, 4>(L);
+  RegisterSocketMetaTable<Sctp::Socket::Server, 6>(L);
+  RegisterSocketMetaTable<Sctp::Socket::Client, 4>(L);
+  RegisterSocketMetaTable<Sctp::Socket::Client, 6>(L);
+  RegisterSocketMetaTable<Sctp::Socket::SeqPacket, 4>(L);
+  RegisterSocketMetaTable<Sctp::Socket::SeqPacket, 6>(L);
+  RegisterWatcherMetaTable<Sctp::Poller>(L, PollerMetaTable);
+  RegisterWatcherMetaTable<Sctp::Scheduler>(L, SchedulerMetaTable);
+  RegisterWatcherMetaTable<Sctp::IoThread>(L, IoThreadMetaTable);
+  RegisterMetaTable<Sctp::Workers>(L, WorkersMetaTable);
+  RegisterMetaTable<Sctp::Buffer>(L, BufferMetaTable);
+  RegisterWatcherMetaTable<Sctp::Pool>(L, PoolMetaTable);
+  RegisterMetaTable<Sctp::AddressSet>(L, AddressSetMetaTable);
+
+  const Lua::Aux::Reg SocketFuncs[] = {
+    { "poller", NewPoller },
+    { "buffer", NewBuffer },
+    { "addrset", NewAddressSet },
+    { "scheduler", NewScheduler },
+    { "iothread", NewIoThread },
+    { "serve_workers", ServeWorkers },
+    { "connectmany", ConnectMany },
+    { "pool", NewPool },
+    { "clock", Clock },
+    { "stats", ModuleStats },
+    { nullptr, nullptr }
+  };
   Lua::Aux::NewLib(L, SocketFuncs);
 
+  //Message flags for sendmany()
+  Lua::PushInteger(L, SCTP_UNORDERED);
+  Lua::SetField(L, -2, "UNORDERED");
+  Lua::PushInteger(L, SCTP_ADDR_OVER);
+  Lua::SetField(L, -2, "ADDR_OVER");
+  Lua::PushInteger(L, SCTP_ABORT);
+  Lua::SetField(L, -2, "ABORT");
+  Lua::PushInteger(L, SCTP_EOF);
+  Lua::SetField(L, -2, "EOF");
+  Lua::PushInteger(L, SCTP_SENDALL);
+  Lua::SetField(L, -2, "SENDALL");
+
   Lua::Newtable(L);
   Lua::PushCFunction(L, New<Sctp::Socket::Server<4>>);
   Lua::SetField(L, -2, "socket4");
   Lua::PushCFunction(L, New<Sctp::Socket::Server<6>>);
   Lua::SetField(L, -2, "socket6");
+  Lua::PushCFunction(L, New<Sctp::Socket::SeqPacket<4>>);
+  Lua::SetField(L, -2, "seqpacket4");
+  Lua::PushCFunction(L, New<Sctp::Socket::SeqPacket<6>>);
+  Lua::SetField(L, -2, "seqpacket6");
   Lua::SetField(L, -2, "server");
 
   Lua::Newtable(L);
@@ -175,6 +838,10 @@ extern "C" int luaopen_sctp(Lua::State* L) {
   Lua::SetField(L, -2, "socket4");
   Lua::PushCFunction(L, New<Sctp::Socket::Client<6>>);
   Lua::SetField(L, -2, "socket6");
+  Lua::PushCFunction(L, New<Sctp::Socket::SeqPacket<4>>);
+  Lua::SetField(L, -2, "seqpacket4");
+  Lua::PushCFunction(L, New<Sctp::Socket::SeqPacket<6>>);
+  Lua::SetField(L, -2, "seqpacket6");
   Lua::SetField(L, -2, "client");
 
   return 1;
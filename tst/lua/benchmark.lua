@@ -0,0 +1,224 @@
+-- Loopback benchmarks: lua benchmark.lua throughput|latency|calls [output.json]
+-- Every suite runs with blocking and non-blocking sockets, over single and multi-homed associations,
+-- prints its results and writes them as JSON (default: <suite>.json)
+local sctp = require "sctp"
+
+local suite, output = ...
+output = output or (suite or "") .. ".json"
+
+local payloadSizes  = { 64, 256, 1024, 4096, 16384, 65536 }
+local maxWindow     = 32    -- messages in flight during the throughput runs,
+local windowBytes   = 65536 -- but no more bytes than this, so a blocking send never waits for the (same) receiver
+local duration      = 0.5   -- seconds per throughput run
+local pingPongs     = 20000
+local warmUp        = 500
+local callRuns      = 1000000 -- method calls per measurement of the binding overhead
+
+local homings = {
+  single = { "127.1.1.1" },
+  multi  = { "127.1.1.1", "127.1.1.2" },
+}
+
+local port = 23456
+
+-- Returns a connected client and the server side peer, or nil and the error
+local function associate(addrs, nonBlocking)
+  port = port + 1
+  local server = sctp.server.socket4()
+  local ok, error = server:bind(port, table.unpack(addrs))
+  if not ok then
+    return nil, error
+  end
+  server:listen()
+  local client = sctp.client.socket4()
+  ok, error = client:connect(port, table.unpack(addrs))
+  if not ok then
+    server:close()
+    return nil, error
+  end
+  local peer = server:accept()
+  server:close()
+  if nonBlocking then
+    client:setnonblocking()
+    peer:setnonblocking()
+  end
+  return client, peer
+end
+
+-- Sends until the window is full or the send buffer is, whichever comes first
+local function fill(client, payload, inFlight, window)
+  while inFlight < window and client:send(payload) do
+    inFlight = inFlight + 1
+  end
+  return inFlight
+end
+
+local function drain(peer, inFlight)
+  local received = 0
+  while received < inFlight and peer:recv() do
+    received = received + 1
+  end
+  return received
+end
+
+local function throughput(client, peer, size)
+  local payload = string.rep("x", size)
+  local window = math.max(1, math.min(maxWindow, windowBytes // size))
+  local messages, inFlight = 0, 0
+  local start = sctp.clock()
+  local elapsed = 0
+  while elapsed < duration do
+    inFlight = fill(client, payload, inFlight, window)
+    local received = drain(peer, inFlight)
+    inFlight = inFlight - received
+    messages = messages + received
+    elapsed = sctp.clock() - start
+  end
+  while inFlight > 0 do
+    inFlight = inFlight - drain(peer, inFlight)
+  end
+  return {
+    payload = size,
+    messages = messages,
+    seconds = elapsed,
+    messages_per_second = messages / elapsed,
+    mbytes_per_second = messages * size / elapsed / 1e6,
+  }
+end
+
+local function receive(sock)
+  local size, msg = sock:recv()
+  while not size do
+    size, msg = sock:recv()
+  end
+  return msg
+end
+
+local function latency(client, peer)
+  local payload = string.rep("x", 64)
+  local samples = {}
+  for i = 1, warmUp + pingPongs do
+    local start = sctp.clock()
+    client:send(payload)
+    peer:send(receive(peer))
+    receive(client)
+    if i > warmUp then
+      samples[#samples + 1] = (sctp.clock() - start) * 1e6
+    end
+  end
+  table.sort(samples)
+  local function percentile(p)
+    return samples[math.max(1, math.ceil(#samples * p))]
+  end
+  return {
+    payload = #payload,
+    round_trips = #samples,
+    min_us = samples[1],
+    p50_us = percentile(0.5),
+    p99_us = percentile(0.99),
+    p999_us = percentile(0.999),
+    max_us = samples[#samples],
+  }
+end
+
+-- Nanoseconds per call of the best of 5 runs
+local function perCall(loop)
+  local best = math.huge
+  for _ = 1, 5 do
+    local start = sctp.clock()
+    loop(callRuns)
+    best = math.min(best, (sctp.clock() - start) / callRuns * 1e9)
+  end
+  return best
+end
+
+-- The cost of calling into the module, against a plain Lua function call
+local function calls(client)
+  local buf = sctp.buffer(16)
+  local poller = sctp.poller()
+  local function empty() end
+  client:getpaddrs()
+  local results = {
+    { call = "lua function", ns_per_call = perCall(function(n) for _ = 1, n do empty() end end) },
+    { call = "buffer:len", ns_per_call = perCall(function(n) for _ = 1, n do buf:len() end end) },
+    { call = "socket:getpaddrs (cached)", ns_per_call = perCall(function(n) for _ = 1, n do client:getpaddrs() end end) },
+    { call = "socket:getopt", ns_per_call = perCall(function(n) for _ = 1, n do client:getopt("nodelay") end end) },
+    -- Takes the socket's descriptor as an argument, which adding it to a poller does
+    { call = "poller:modify (socket)", ns_per_call = perCall(function(n)
+      poller:add(client)
+      for _ = 1, n do poller:modify(client, "r") end
+      poller:remove(client)
+    end) },
+  }
+  poller:close()
+  return results
+end
+
+local function toJson(value, indent)
+  indent = indent or ""
+  if type(value) == "table" then
+    local inner, parts = indent .. "  ", {}
+    if #value > 0 then
+      for _, v in ipairs(value) do
+        parts[#parts + 1] = inner .. toJson(v, inner)
+      end
+      return "[\n" .. table.concat(parts, ",\n") .. "\n" .. indent .. "]"
+    end
+    local keys = {}
+    for k in pairs(value) do
+      keys[#keys + 1] = k
+    end
+    table.sort(keys)
+    for _, k in ipairs(keys) do
+      parts[#parts + 1] = string.format("%s%q: %s", inner, k, toJson(value[k], inner))
+    end
+    return "{\n" .. table.concat(parts, ",\n") .. "\n" .. indent .. "}"
+  elseif type(value) == "string" then
+    return string.format("%q", value)
+  elseif math.type(value) == "float" then
+    return string.format("%.3f", value)
+  end
+  return tostring(value)
+end
+
+local suites = {
+  throughput = function(client, peer)
+    local results = {}
+    for _, size in ipairs(payloadSizes) do
+      results[#results + 1] = throughput(client, peer, size)
+    end
+    return results
+  end,
+  latency = function(client, peer)
+    return { latency(client, peer) }
+  end,
+  calls = calls,
+}
+
+if not suites[suite] then
+  io.stderr:write("usage: lua benchmark.lua throughput|latency|calls [output.json]\n")
+  os.exit(1)
+end
+
+local results = {}
+for _, homing in ipairs({ "single", "multi" }) do
+  for _, mode in ipairs({ "blocking", "nonblocking" }) do
+    local client, peer = associate(homings[homing], mode == "nonblocking")
+    if not client then
+      io.stderr:write(string.format("%s/%s: %s\n", homing, mode, peer))
+      os.exit(1)
+    end
+    for _, result in ipairs(suites[suite](client, peer)) do
+      result.homing = homing
+      result.mode   = mode
+      results[#results + 1] = result
+      print(toJson(result))
+    end
+    client:close()
+    peer:close()
+  end
+end
+
+local file = assert(io.open(output, "w"))
+file:write(toJson({ suite = suite, results = results }), "\n")
+file:close()
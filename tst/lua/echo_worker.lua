@@ -0,0 +1,12 @@
+-- Run by the serve_workers test in each worker thread: echoes a message per association until stopped
+local server = ...
+while true do
+  local peer, err = server:accept()
+  if not peer then
+    assert(err == "stopped", err)
+    return
+  end
+  local _, msg = peer:recv()
+  peer:send(msg)
+  peer:close()
+end
@@ -68,3 +68,586 @@ printResult(x == 10 and y == 100, error)
 server:close()
 client:close()
 client2:close()
+
+io.write("send/receive(seqpacket): ")
+local server = sctp.server.seqpacket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.seqpacket4()
+local _, assocId = client:connect(12345, "127.1.1.1")
+client:send(string.pack("ii", 10, 100), assocId)
+local count, msg, peerAssocId = server:recv()
+server:send(string.pack("ii", 20, 200), peerAssocId)
+local _, reply = client:recv()
+local x, y = string.unpack("ii", msg)
+local z, w = string.unpack("ii", reply)
+printResult(x == 10 and y == 100 and z == 20 and w == 200, error)
+server:close()
+client:close()
+
+io.write("send(seqpacket, implicit multi-homed association): ")
+local server = sctp.server.seqpacket4()
+server:bind(12345, "127.1.1.1", "127.3.3.3")
+server:listen()
+
+local client = sctp.client.seqpacket4()
+client:send("hello", 12345, "127.1.1.1", "127.3.3.3")
+local _, _, peerAssocId = server:recv()
+server:send("hi", peerAssocId)
+local _, reply, assocId = client:recv()
+printResult(reply == "hi" and #client:getpaddrs(assocId) == 2, error)
+server:close()
+client:close()
+
+
+io.write("send/receive(large message): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4(1000)
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local payload = string.rep("0123456789", 2000)
+client2:send(payload)
+local count, msg = client:recv()
+printResult(count == #payload and msg == payload, error)
+server:close()
+client:close()
+client2:close()
+
+io.write("recvmany: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+for i = 1, 10 do
+  client:send(string.pack("i", i))
+end
+local received = {}
+while #received < 10 do
+  local count, msgs = client2:recvmany(4)
+  for _, msg in ipairs(msgs) do
+    received[#received + 1] = string.unpack("i", msg)
+  end
+end
+printResult(#received == 10 and received[1] == 1 and received[10] == 10, error)
+server:close()
+client:close()
+client2:close()
+
+io.write("sendmany: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local sent = client:sendmany({ "first", { "second", 0, 42, sctp.UNORDERED }, "third" })
+local _, first = client2:recv()
+local _, second = client2:recv()
+local _, third = client2:recv()
+printResult(sent == 3 and first == "first" and second == "second" and third == "third", error)
+server:close()
+client:close()
+client2:close()
+
+io.write("poller: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+server:setnonblocking()
+
+local poller = sctp.poller()
+poller:add(server, "r")
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+
+local count, socks, events = poller:wait(1000)
+local accepted = count == 1 and socks[1] == server and events[1] == "r"
+local client2 = server:accept()
+poller:add(client2, "r")
+client:send("ping")
+count, socks, events = poller:wait(1000)
+local ready = count == 1 and socks[1] == client2 and events[1] == "r"
+--Closing a socket drops it from the poller
+local dropped = setmetatable({ client2 }, { __mode = "v" })
+client2:close()
+client2, socks = nil, nil
+collectgarbage()
+printResult(accepted and ready and dropped[1] == nil, error)
+poller:close()
+server:close()
+client:close()
+
+io.write("acceptmany: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+server:setnonblocking()
+
+local clients = {}
+for i = 1, 3 do
+  clients[i] = sctp.client.socket4()
+  clients[i]:connect(12345, "127.1.1.1")
+end
+local count, accepted = server:acceptmany(10)
+printResult(count == 3 and #accepted == 3, error)
+for i = 1, 3 do
+  clients[i]:close()
+  accepted[i]:close()
+end
+server:close()
+
+io.write("send(opts): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local sent = client:send("options", { stream = 1, ppid = 42, unordered = true, ttl = 1000 })
+local _, msg = client2:recv()
+printResult(sent == 7 and msg == "options", error)
+server:close()
+client:close()
+client2:close()
+
+io.write("recv(info): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+client:send("info", { stream = 1, ppid = 42 })
+local info = {}
+local _, msg, filled = client2:recv(info)
+printResult(msg == "info" and filled == info and info.stream == 1 and info.ppid == 42, error)
+server:close()
+client:close()
+client2:close()
+
+io.write("notifications: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+server:subscribe({ assoc_change = true })
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local _, notification = client2:recv()
+printResult(type(notification) == "table" and notification.type == "assoc_change" and notification.state == "comm_up", error)
+server:close()
+client:close()
+client2:close()
+
+io.write("recv_into: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local buf = sctp.buffer(64)
+buf:fill()
+buf:setu16(0, 0xBEEF)
+buf:setstring(2, "into")
+client:send(buf:string(0, 6))
+local size, complete = client2:recv_into(buf, 8)
+printResult(size == 6 and complete == true and buf:u16(8) == 0xBEEF and buf:string(10, 4) == "into", error)
+server:close()
+client:close()
+client2:close()
+
+io.write("recv_into(notification): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+server:subscribe({ assoc_change = true })
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local buf = sctp.buffer(64)
+local noSpace = not pcall(client2.recv_into, client2, buf, 64)
+local size, notification = client2:recv_into(buf, 60)
+printResult(noSpace and size > 4 and type(notification) == "table" and notification.type == "assoc_change", error)
+server:close()
+client:close()
+client2:close()
+
+io.write("send(buffer slice): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local buf = sctp.buffer(32)
+local length = buf:setstring(4, "slice")
+local sent = client:send(buf, 4, length - 4, { stream = 1 })
+local _, msg = client2:recv()
+printResult(sent == 5 and msg == "slice", error)
+server:close()
+client:close()
+client2:close()
+
+io.write("scheduler: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+server:setnonblocking()
+
+local scheduler = sctp.scheduler()
+local echoed
+scheduler:spawn(function()
+  local peer = server:accept()
+  local _, msg = peer:recv()
+  peer:send(msg)
+  peer:close()
+end)
+scheduler:spawn(function()
+  local client = sctp.client.socket4()
+  client:setnonblocking()
+  client:connect(12345, "127.1.1.1")
+  client:send("yield")
+  _, echoed = client:recv()
+  client:close()
+end)
+printResult(scheduler:run(1000) and echoed == "yield", error)
+server:close()
+
+io.write("scheduler(close): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+server:setnonblocking()
+
+local scheduler = sctp.scheduler()
+local accepted, reason
+scheduler:spawn(function()
+  accepted, reason = server:accept()
+end)
+scheduler:spawn(function()
+  coroutine.yield()
+  server:close()
+end)
+printResult(scheduler:run(1000) and accepted == false and reason ~= nil, error)
+
+io.write("iothread: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local ioThread = sctp.iothread()
+ioThread:attach(client)
+ioThread:attach(client2)
+ioThread:send(client, "threaded")
+ioThread:wait(1000)
+local count, msgs, socks = ioThread:poll()
+printResult(count == 1 and msgs[1] == "threaded" and socks[1] == client2, error)
+ioThread:close()
+server:close()
+client:close()
+client2:close()
+
+io.write("iothread(detach): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local ioThread = sctp.iothread()
+ioThread:attach(client)
+ioThread:attach(client2)
+ioThread:detach(client2)
+client:close()
+client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+ioThread:attach(client)
+ioThread:send(client, "reused")
+local poller = sctp.poller()
+poller:add(client2, "r")
+poller:wait(1000)
+local size, msg = client2:recv()
+printResult(msg == "reused" and ioThread:poll() == 0, error)
+ioThread:close()
+server:close()
+client:close()
+client2:close()
+
+io.write("iothread(reuse): ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local client2 = server:accept()
+
+local ioThread = sctp.iothread()
+ioThread:attach(client)
+client2:send("stale")
+ioThread:wait(1000)
+client:close()
+--Most likely gets the descriptor number of the closed one
+client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+ioThread:attach(client)
+local count, msgs, socks = ioThread:poll()
+printResult(count == 1 and msgs[1] == "stale" and socks[1] == nil, error)
+ioThread:close()
+server:close()
+client:close()
+client2:close()
+
+io.write("serve_workers: ")
+local dir = arg[0]:match("(.*/)") or ""
+local workers = sctp.serve_workers({ port = 12345, addrs = { "127.1.1.1" }, workers = 4, script = dir .. "echo_worker.lua" })
+
+local clients, echoed = {}, 0
+for i = 1, 2 do
+  clients[i] = sctp.client.socket4()
+  clients[i]:connect(12345, "127.1.1.1")
+  clients[i]:send("worker")
+end
+for i = 1, 2 do
+  local _, msg = clients[i]:recv()
+  echoed = echoed + (msg == "worker" and 1 or 0)
+  clients[i]:close()
+end
+workers:stop()
+printResult(workers:join() and echoed == 2, error)
+
+io.write("peeloff: ")
+local server = sctp.server.seqpacket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.seqpacket4()
+local _, assocId = client:connect(12345, "127.1.1.1")
+client:send("before", assocId)
+local _, _, peerAssocId = server:recv()
+local peer = server:peeloff(peerAssocId, { nonblocking = false })
+client:send("after", assocId)
+local _, msg = peer:recv()
+printResult(msg == "after", error)
+peer:close()
+server:close()
+client:close()
+
+io.write("setopt/getopt: ")
+local server = sctp.server.socket4()
+local ok = server:setopt("initmsg", { ostreams = 7, instreams = 9 })
+  and server:setopt("nodelay", true)
+  and server:setopt("rtoinfo", { max = 5000 })
+local initMsg = server:getopt("initmsg")
+printResult(ok and initMsg.ostreams == 7 and initMsg.instreams == 9
+  and server:getopt("nodelay") == true and server:getopt("rtoinfo").max == 5000, error)
+server:close()
+
+io.write("default_sndinfo: ")
+local server = sctp.server.socket4()
+server:setopt("default_sndinfo", { stream = 1, ppid = 7, unordered = true })
+server:setopt("default_sndinfo", { ppid = 9 })
+local sndInfo = server:getopt("default_sndinfo")
+local ttlRejected = not pcall(server.setopt, server, "default_sndinfo", { ttl = 100 })
+printResult(sndInfo.stream == 1 and sndInfo.ppid == 9 and sndInfo.unordered == true and ttlRejected, error)
+server:close()
+
+io.write("fragment_interleave: ")
+local server = sctp.server.socket4()
+server:setopt("fragment_interleave", 2)
+--Fails where I-DATA isn't enabled (net.sctp.intl_enable), the messages come whole either way
+server:setopt("interleaving", true)
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local peer = server:accept()
+local big = string.rep("i", 100000)
+client:send(big, { stream = 1 })
+client:send("small", { stream = 2 })
+local _, first = peer:recv()
+local _, second = peer:recv()
+printResult(server:getopt("fragment_interleave") == 2
+  and ((first == big and second == "small") or (first == "small" and second == big)), error)
+client:close()
+peer:close()
+server:close()
+
+io.write("stream scheduler: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:setopt("initmsg", { ostreams = 2 })
+client:setopt("stream_scheduler", "prio")
+client:connect(12345, "127.1.1.1")
+local peer = server:accept()
+printResult(client:getopt("stream_scheduler") == "prio" and client:setpriority(1, 10)
+  and client:getpriority(1) == 10, error)
+peer:close()
+client:close()
+server:close()
+
+io.write("partial reliability: ")
+local server = sctp.server.socket4()
+server:setopt("rcvbuf", 4096)
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:setopt("pr_supported", true)
+client:setopt("sndbuf", 8192)
+client:connect(12345, "127.1.1.1")
+local peer = server:accept()
+client:setnonblocking()
+--The peer doesn't read, so its window closes and the low priority messages pile up until the send buffer is full
+local payload = string.rep("x", 1000)
+local full = false
+for i = 1, 1000 do
+  if not client:send(payload, { prio = 5 }) then
+    full = true
+    break
+  end
+end
+--Room for the urgent one is made by abandoning low priority ones
+client:send(payload, { prio = 0 })
+local unsent, sent = client:abandoned()
+local rejected = not pcall(client.send, client, payload, { ttl = 0, rtx = 0 })
+printResult(full and client:getopt("pr_supported") == true and unsent + sent > 0 and rejected, error)
+peer:close()
+client:close()
+server:close()
+
+io.write("getpaddrs/getladdrs: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local peer = server:accept()
+local paddrs = client:getpaddrs()
+local laddrs = server:getladdrs()
+printResult(paddrs[1] == "127.1.1.1" and paddrs.port == 12345 and client:getpaddrs() == paddrs
+  and laddrs[1] == "127.1.1.1", error)
+peer:close()
+client:close()
+server:close()
+
+io.write("addrset: ")
+local addrs = sctp.addrset(12345, "127.1.1.1")
+local server = sctp.server.socket4()
+server:bind(addrs)
+server:listen()
+
+local client = sctp.client.socket4()
+local ok = client:connect(addrs)
+local peer = server:accept()
+printResult(ok and #addrs == 1 and not sctp.addrset(12345, "127.1.1.1", "::1"), error)
+peer:close()
+client:close()
+server:close()
+
+io.write("connectmany: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local specs, clients = {}, {}
+for i = 1, 3 do
+  clients[i] = sctp.client.socket4()
+  clients[i]:setnonblocking()
+  specs[i] = { clients[i], 12345, "127.1.1.1" }
+end
+local started, assocIds = sctp.connectmany(specs)
+local peers = {}
+for i = 1, 3 do
+  peers[i] = server:accept()
+end
+printResult(started == 3 and type(assocIds[1]) == "number" and #peers == 3, error)
+for i = 1, 3 do
+  peers[i]:close()
+  clients[i]:close()
+end
+server:close()
+
+io.write("pool: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local addrs = sctp.addrset(12345, "127.1.1.1")
+local pool = sctp.pool{ max_per_peer = 1 }
+local first = pool:acquire(addrs)
+local peer = server:accept()
+local _, limit = pool:acquire(sctp.addrset(12345, "127.1.1.1"))
+pool:release(first)
+local second = pool:acquire(addrs)
+pool:release(second, false)
+local emptied = pool:size(addrs) == 0
+local third = pool:acquire(addrs)
+pool:release(third)
+local releasedTwice = pcall(pool.release, pool, third)
+--Closing a socket instead of releasing it frees its place
+pool:acquire(addrs):close()
+local fourth = pool:acquire(addrs)
+printResult(first == second and limit == "limit" and emptied and not releasedTwice and fourth and pool:size(addrs) == 1, error)
+pool:release(fourth, false)
+peer:close()
+server:close()
+
+io.write("stats: ")
+local server = sctp.server.socket4()
+server:bind(12345, "127.1.1.1")
+server:listen()
+
+local client = sctp.client.socket4()
+client:connect(12345, "127.1.1.1")
+local peer = server:accept()
+local before = sctp.stats()
+client:send("hello")
+peer:recv()
+local stats, error = client:stats()
+if stats then
+  local after = sctp.stats()
+  printResult(stats.messages_sent == 1 and stats.bytes_sent == 5 and peer:stats().bytes_received == 5
+    and server:stats().accepted == 1 and after.messages_sent == before.messages_sent + 1, error)
+else
+  printResult(error == "stats: disabled at build time", error)
+end
+peer:close()
+client:close()
+server:close()
\ No newline at end of file